@@ -9,500 +9,3212 @@
 #include <SDL_image.h>
 #include <SDL_mixer.h>
 #include <cstring>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <deque>
+#include <type_traits>
+#include <cstddef>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 800;
 const int GRID_SIZE = 40;
-const int MAP_ROWS = SCREEN_HEIGHT / GRID_SIZE;
-const int MAP_COLS = SCREEN_WIDTH / GRID_SIZE;
+// Speeds are pixels per second and timers milliseconds, so the tick rate changes smoothness, not game speed.
+// At 30 ticks/s a bullet still moves no more than its own size per tick and cannot pass through a sub-cell.
+const int DEFAULT_TICK_RATE = 60;
+const int MIN_TICK_RATE = 30;
+const int MAX_TICK_RATE = 240;
+// World size in tiles, independent of the window; the camera scrolls when the world is larger than the screen.
+// Build with e.g. -DBATTLECITY_MAP_COLS=500 -DBATTLECITY_MAP_ROWS=500 for large maps.
+#ifndef BATTLECITY_MAP_ROWS
+#define BATTLECITY_MAP_ROWS 20
+#endif
+#ifndef BATTLECITY_MAP_COLS
+#define BATTLECITY_MAP_COLS 20
+#endif
+const int MAP_ROWS = BATTLECITY_MAP_ROWS;
+const int MAP_COLS = BATTLECITY_MAP_COLS;
+const int WORLD_WIDTH = MAP_COLS * GRID_SIZE;
+const int WORLD_HEIGHT = MAP_ROWS * GRID_SIZE;
+static_assert(MAP_ROWS >= 20 && MAP_COLS >= 20, "the built-in map needs at least 20x20 tiles");
+
+// Read-only mapping of a whole file. Pages are mapped copy-on-write and shared with the OS file cache.
+class MappedFile {
+public:
+    const Uint8* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+#ifdef _WIN32
+    MappedFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+    MappedFile() : data(nullptr), size(0), fd(-1) {}
+#endif
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
 
-enum GameState {
-    STATE_MENU,
-    STATE_1P,
-    STATE_2P,
-    STATE_GAME_OVER
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (mapping) data = static_cast<const Uint8*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(info.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) data = static_cast<const Uint8*>(mapped);
+#endif
+        if (!data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(const_cast<Uint8*>(data), size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
 };
 
-enum PowerUpType {
-    POWERUP_NONE,
-    POWERUP_HEALTH,
-    POWERUP_FREEZE,
-    POWERUP_INVINCIBLE,
-    POWERUP_BOMB
+// Every file the game loads, as named inside a packed archive and as loose files next to the binary.
+static const char* const GAME_ASSETS[] = {
+    "nenmenu.jpg", "khungmenu.jpg", "tank.png", "tankenemy.png", "bullet.png", "wall.png", "powerup.png",
+    "shoot.mp3", "explosion.mp3", "powerup.mp3", "nhacnen.mp3"
+};
+static const char* const ARCHIVE_FONT = "font.ttf";
+
+// Tried in order when no font is packed, and by the packer when it is not given one.
+static const char* const SYSTEM_FONTS[] = {
+    "C:/Windows/Fonts/arial.ttf",
+    "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/TTF/DejaVuSans.ttf",
+    "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+    "/usr/share/fonts/liberation/LiberationSans-Regular.ttf",
+    "/System/Library/Fonts/Supplemental/Arial.ttf"
 };
 
-class PowerUp {
+// Header of a .bcpk asset archive: file contents 16-byte aligned after the header, then an index of entries
+// sorted by name at indexOffset. Little-endian, used in place from the mapping.
+struct ArchiveHeader {
+    char magic[4];
+    Uint32 version;
+    Uint32 entryCount;
+    Uint32 indexOffset;
+};
+
+struct ArchiveEntry {
+    char name[56];
+    Uint32 offset;
+    Uint32 size;
+};
+
+class AssetArchive {
 public:
-    SDL_Rect rect;
-    PowerUpType type;
-    bool active;
-    Uint32 spawnTime;
-    const Uint32 duration = 10000;
-    SDL_Texture* texture;
+    static const Uint32 VERSION = 1;
 
-    PowerUp() : type(POWERUP_NONE), active(false), texture(nullptr) {
-        rect = {0, 0, GRID_SIZE, GRID_SIZE};
-    }
+    MappedFile file;
+    const ArchiveEntry* entries;
+    Uint32 entryCount;
 
-    void spawn(int x, int y, PowerUpType t) {
-        rect.x = x;
-        rect.y = y;
-        type = t;
-        active = true;
-        spawnTime = SDL_GetTicks();
+    AssetArchive() : entries(nullptr), entryCount(0) {}
+
+    bool isOpen() const {
+        return entries != nullptr;
     }
 
-    void update() {
-        if (!active) return;
-        if (SDL_GetTicks() - spawnTime > duration) {
-            active = false;
+    bool open(const std::string& path) {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        std::cerr << "Asset archives are little-endian only: " << path << std::endl;
+        return false;
+#else
+        if (!file.open(path)) return false;
+        const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(file.data);
+        bool valid = file.size >= sizeof(ArchiveHeader) && memcmp(header->magic, "BCPK", 4) == 0 &&
+                     header->version == VERSION && header->indexOffset % alignof(ArchiveEntry) == 0 &&
+                     header->indexOffset <= file.size &&
+                     header->entryCount <= (file.size - header->indexOffset) / sizeof(ArchiveEntry);
+        const ArchiveEntry* index = valid ? reinterpret_cast<const ArchiveEntry*>(file.data + header->indexOffset) : nullptr;
+        for (Uint32 i = 0; valid && i < header->entryCount; ++i) {
+            const ArchiveEntry& entry = index[i];
+            valid = memchr(entry.name, 0, sizeof(entry.name)) != nullptr && entry.offset <= file.size &&
+                    entry.size <= file.size - entry.offset && (i == 0 || strcmp(index[i - 1].name, entry.name) < 0);
+        }
+        if (!valid) {
+            std::cerr << "Invalid asset archive: " << path << std::endl;
+            file.close();
+            return false;
         }
+        entries = index;
+        entryCount = header->entryCount;
+        return true;
+#endif
     }
 
-    void render(SDL_Renderer* renderer) {
-        if (!active) return;
-        if (texture) {
-            SDL_RenderCopy(renderer, texture, nullptr, &rect);
-        } else {
+    const ArchiveEntry* find(const char* name) const {
+        const ArchiveEntry* end = entries + entryCount;
+        const ArchiveEntry* it = std::lower_bound(entries, end, name, [](const ArchiveEntry& entry, const char* key) {
+            return strcmp(entry.name, key) < 0;
+        });
+        return it != end && strcmp(it->name, name) == 0 ? it : nullptr;
+    }
 
-            switch (type) {
-                case POWERUP_HEALTH: SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255); break;
-                case POWERUP_FREEZE: SDL_SetRenderDrawColor(renderer, 0, 255, 255, 255); break;
-                case POWERUP_INVINCIBLE: SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255); break;
-                case POWERUP_BOMB: SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255); break;
-                default: return;
+    // Reads straight from the mapping; names missing from the archive fall back to a loose file, so an
+    // unpacked checkout still runs. Safe to call from loader threads.
+    SDL_RWops* openAsset(const char* name) const {
+        const ArchiveEntry* entry = isOpen() ? find(name) : nullptr;
+        if (entry) return SDL_RWFromConstMem(file.data + entry->offset, static_cast<int>(entry->size));
+        return SDL_RWFromFile(name, "rb");
+    }
+
+    // files holds (name in archive, source path) pairs.
+    static bool write(const std::string& path, std::vector<std::pair<std::string, std::string>> files) {
+        std::sort(files.begin(), files.end());
+        std::vector<ArchiveEntry> index(files.size());
+        std::vector<std::vector<char>> contents(files.size());
+        Uint32 offset = sizeof(ArchiveHeader);
+        for (size_t i = 0; i < files.size(); ++i) {
+            const std::string& name = files[i].first;
+            if (name.size() >= sizeof(index[i].name) || (i > 0 && name == files[i - 1].first)) {
+                std::cerr << "Bad or duplicate archive name: " << name << std::endl;
+                return false;
+            }
+            std::ifstream in(files[i].second, std::ios::binary);
+            if (!in) {
+                std::cerr << "Failed to read asset: " << files[i].second << std::endl;
+                return false;
             }
-            SDL_RenderFillRect(renderer, &rect);
+            contents[i].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            std::memset(&index[i], 0, sizeof(ArchiveEntry));
+            memcpy(index[i].name, name.c_str(), name.size());
+            offset = (offset + 15) & ~15u;
+            index[i].offset = offset;
+            index[i].size = static_cast<Uint32>(contents[i].size());
+            offset += index[i].size;
+        }
+
+        ArchiveHeader header;
+        memcpy(header.magic, "BCPK", 4);
+        header.version = VERSION;
+        header.entryCount = static_cast<Uint32>(index.size());
+        header.indexOffset = (offset + 15) & ~15u;
+
+        std::ofstream out(path, std::ios::binary);
+        auto padTo = [&out](Uint32 position) {
+            while (out && static_cast<Uint32>(out.tellp()) < position) out.put(0);
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (size_t i = 0; i < index.size(); ++i) {
+            padTo(index[i].offset);
+            out.write(contents[i].data(), contents[i].size());
+        }
+        padTo(header.indexOffset);
+        out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(ArchiveEntry));
+        if (!out) {
+            std::cerr << "Failed to write asset archive: " << path << std::endl;
+            return false;
         }
+        return true;
     }
 };
 
-class Bullet {
+typedef std::shared_ptr<SDL_Texture> TextureHandle;
+
+class AssetCache {
 public:
-    SDL_Rect rect;
-    int dx, dy;
-    bool active;
     SDL_Renderer* renderer;
-    SDL_Texture* bulletTexture;
+    const AssetArchive* archive;
+    std::map<std::string, TextureHandle> textures;
+
+    AssetCache() : renderer(nullptr), archive(nullptr) {}
+
+    ~AssetCache() {
+        clear();
+    }
 
-    Bullet(SDL_Renderer* rend, int x, int y, int direction) : renderer(rend), active(true), bulletTexture(nullptr) {
-        rect = {x, y, 10, 10};
-        dx = (direction == 1 || direction == 3) ? 5 * (direction == 1 ? -1 : 1) : 0;
-        dy = (direction == 0 || direction == 2) ? 5 * (direction == 0 ? -1 : 1) : 0;
+    TextureHandle getTexture(const std::string& path) {
+        auto it = textures.find(path);
+        if (it != textures.end()) return it->second;
 
-        SDL_Surface* surface = IMG_Load("bullet.png");
+        TextureHandle handle;
+        SDL_Surface* surface = IMG_Load_RW(archive->openAsset(path.c_str()), 1);
         if (!surface) {
-            std::cerr << "Failed to load bullet texture: " << IMG_GetError() << std::endl;
+            std::cerr << "Failed to load texture " << path << ": " << IMG_GetError() << std::endl;
         } else {
-            bulletTexture = SDL_CreateTextureFromSurface(renderer, surface);
+            SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
             SDL_FreeSurface(surface);
+            if (texture) handle = TextureHandle(texture, SDL_DestroyTexture);
         }
+        textures[path] = handle;
+        return handle;
     }
 
-    ~Bullet() {
-        if (bulletTexture) SDL_DestroyTexture(bulletTexture);
-    }
-
-    void update(std::vector<SDL_Rect>& walls, std::vector<bool>& wallBreakable) {
-        if (!active) return;
-        rect.x += dx;
-        rect.y += dy;
-        for (const auto& wall : walls) {
-            if (SDL_HasIntersection(&rect, &wall)) {
-                active = false;
-                return;
-            }
-        }
-        if (rect.x < 0 || rect.x > SCREEN_WIDTH || rect.y < 0 || rect.y > SCREEN_HEIGHT) {
-            active = false;
-        }
+    void preload(const char* const* paths, int count) {
+        for (int i = 0; i < count; ++i) getTexture(paths[i]);
     }
 
-    void render() {
-        if (!active || !bulletTexture) return;
-        SDL_RenderCopy(renderer, bulletTexture, nullptr, &rect);
+    void clear() {
+        textures.clear();
     }
 };
 
-class PlayerTank {
+// Runs load jobs (file reads, image and audio decoding) on background threads. Each job's finish step runs on
+// the render thread from poll(), in submission order, and is where any GPU work belongs.
+class AssetLoader {
 public:
-    SDL_Renderer* renderer;
-    std::vector<Bullet> bullets;
-    int direction;
-    bool alive;
-    float x, y;
-    float speed;
-    const int width = GRID_SIZE;
-    const int height = GRID_SIZE;
-    bool keys[4];
-    bool invincible;
-    Uint32 invincibleEndTime;
-    const int maxHealth = 1000;
-    int health;
-    SDL_Texture* tankTexture;
-    SDL_Rect rect;
-    Mix_Chunk* shootSound;
+    struct Job {
+        std::function<void()> load;
+        std::function<void()> finish;
+    };
 
-    PlayerTank(SDL_Renderer* rend, int startX, int startY, Mix_Chunk* sound) : renderer(rend), alive(true),
-        invincible(false), invincibleEndTime(0), health(maxHealth), tankTexture(nullptr), shootSound(sound) {
-        x = static_cast<float>(startX);
-        y = static_cast<float>(startY);
-        rect = {startX, startY, width, height};
-        direction = 0;
-        speed = 3.0f;
-        keys[0] = keys[1] = keys[2] = keys[3] = false;
+    std::vector<Job> jobs;
+    std::unique_ptr<std::atomic<bool>[]> loaded;
+    std::vector<std::thread> threads;
+    std::atomic<int> nextJob;
+    int finishedJobs;
 
-        SDL_Surface* surface = IMG_Load("tank.png");
-        if (!surface) {
-            std::cerr << "Failed to load player tank texture: " << IMG_GetError() << std::endl;
-        } else {
-            tankTexture = SDL_CreateTextureFromSurface(renderer, surface);
-            SDL_FreeSurface(surface);
-        }
+    AssetLoader() : nextJob(0), finishedJobs(0) {}
+
+    ~AssetLoader() {
+        wait();
     }
 
-    ~PlayerTank() {
-        if (tankTexture) SDL_DestroyTexture(tankTexture);
+    void add(std::function<void()> load, std::function<void()> finish) {
+        jobs.push_back({load, finish});
     }
 
-    void heal(int amount = 200) {
-        if (health < maxHealth) {
-            health = std::min(maxHealth, health + amount);
+    void start(int threadCount) {
+        loaded.reset(new std::atomic<bool>[jobs.size()]);
+        for (size_t i = 0; i < jobs.size(); ++i) loaded[i] = false;
+        nextJob = 0;
+        finishedJobs = 0;
+        int count = std::max(1, std::min(threadCount, static_cast<int>(jobs.size())));
+        for (int t = 0; t < count; ++t) {
+            threads.emplace_back([this] {
+                for (;;) {
+                    int job = nextJob.fetch_add(1);
+                    if (job >= static_cast<int>(jobs.size())) return;
+                    if (jobs[job].load) jobs[job].load();
+                    loaded[job].store(true, std::memory_order_release);
+                }
+            });
         }
     }
 
-    void takeDamage() {
-        if (!invincible) {
-            health -= 100;
-            if (health <= 0) {
-                alive = false;
-            }
+    // Finishes every job whose load has completed, stopping at the first one still loading.
+    bool poll() {
+        while (finishedJobs < static_cast<int>(jobs.size()) && loaded[finishedJobs].load(std::memory_order_acquire)) {
+            if (jobs[finishedJobs].finish) jobs[finishedJobs].finish();
+            finishedJobs++;
         }
+        if (done()) wait();
+        return done();
     }
 
-    void activateInvincible(Uint32 duration) {
-        if (!invincible) {
-            invincible = true;
-            invincibleEndTime = SDL_GetTicks() + duration;
-        }
+    bool done() const {
+        return finishedJobs == static_cast<int>(jobs.size());
     }
 
-    void updateInvincible() {
-        if (invincible && SDL_GetTicks() > invincibleEndTime) {
-            invincible = false;
-        }
+    float progress() const {
+        return jobs.empty() ? 1.0f : static_cast<float>(finishedJobs) / jobs.size();
     }
 
-    bool checkPowerUpCollision(const SDL_Rect& powerUpRect) {
-        return SDL_HasIntersection(&rect, &powerUpRect);
+    void wait() {
+        for (std::thread& thread : threads) thread.join();
+        threads.clear();
     }
+};
 
-    void handleInput(SDL_Event& event, bool isPlayer1) {
-        if (!alive) return;
+struct TextMesh {
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
 
-        bool keyDown = (event.type == SDL_KEYDOWN);
+    void clear() {
+        vertices.clear();
+        indices.clear();
+    }
+};
 
-        if (isPlayer1) {
-            switch (event.key.keysym.sym) {
-                case SDLK_UP: keys[0] = keyDown; break;
-                case SDLK_LEFT: keys[1] = keyDown; break;
-                case SDLK_DOWN: keys[2] = keyDown; break;
-                case SDLK_RIGHT: keys[3] = keyDown; break;
-                case SDLK_SPACE: if (keyDown) shoot(); break;
-            }
-        } else {
-            switch (event.key.keysym.sym) {
-                case SDLK_w: keys[0] = keyDown; break;
-                case SDLK_a: keys[1] = keyDown; break;
-                case SDLK_s: keys[2] = keyDown; break;
-                case SDLK_d: keys[3] = keyDown; break;
-                case SDLK_RETURN: if (keyDown) shoot(); break;
-            }
-        }
+class GlyphAtlas {
+public:
+    static const int FIRST_CHAR = 32;
+    static const int LAST_CHAR = 126;
+    static constexpr int ATLAS_WIDTH = 512;
+
+    struct Glyph {
+        SDL_Rect src;
+        int advance;
+    };
+
+    SDL_Texture* texture;
+    int atlasWidth;
+    int atlasHeight;
+    int lineHeight;
+    Glyph glyphs[LAST_CHAR - FIRST_CHAR + 1];
+
+    GlyphAtlas() : texture(nullptr), atlasWidth(0), atlasHeight(0), lineHeight(0) {
+        std::memset(glyphs, 0, sizeof(glyphs));
     }
 
-    void update(const std::vector<SDL_Rect>& walls, const SDL_Rect* otherPlayerRect = nullptr) {
-        if (!alive) return;
+    ~GlyphAtlas() {
+        release();
+    }
 
-        float newX = x;
-        float newY = y;
+    void release() {
+        if (texture) SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
 
-        if (keys[0]) {
-            newY -= speed;
-            direction = 0;
-        }
-        if (keys[2]) {
-            newY += speed;
-            direction = 2;
+    bool build(SDL_Renderer* renderer, TTF_Font* font) {
+        if (!font) return false;
+        SDL_Color white = {255, 255, 255, 255};
+        SDL_Surface* surfaces[LAST_CHAR - FIRST_CHAR + 1] = {};
+
+        int penX = 0, penY = 0, rowHeight = 0;
+        for (int c = FIRST_CHAR; c <= LAST_CHAR; ++c) {
+            Glyph& glyph = glyphs[c - FIRST_CHAR];
+            int minX, maxX, minY, maxY;
+            if (TTF_GlyphMetrics(font, static_cast<Uint16>(c), &minX, &maxX, &minY, &maxY, &glyph.advance) != 0) {
+                glyph.advance = 0;
+            }
+            SDL_Surface* surface = TTF_RenderGlyph_Blended(font, static_cast<Uint16>(c), white);
+            surfaces[c - FIRST_CHAR] = surface;
+            if (!surface) continue;
+
+            if (penX + surface->w > ATLAS_WIDTH) {
+                penX = 0;
+                penY += rowHeight + 1;
+                rowHeight = 0;
+            }
+            glyph.src = {penX, penY, surface->w, surface->h};
+            penX += surface->w + 1;
+            rowHeight = std::max(rowHeight, surface->h);
         }
-        if (keys[1]) {
-            newX -= speed;
-            direction = 1;
+
+        atlasWidth = ATLAS_WIDTH;
+        atlasHeight = penY + rowHeight;
+        lineHeight = TTF_FontHeight(font);
+
+        SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, std::max(1, atlasHeight), 32,
+                                                            SDL_PIXELFORMAT_RGBA32);
+        if (atlas) {
+            for (int i = 0; i <= LAST_CHAR - FIRST_CHAR; ++i) {
+                if (!surfaces[i]) continue;
+                SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+                SDL_Rect dst = glyphs[i].src;
+                SDL_BlitSurface(surfaces[i], nullptr, atlas, &dst);
+            }
+            texture = SDL_CreateTextureFromSurface(renderer, atlas);
+            SDL_FreeSurface(atlas);
         }
-        if (keys[3]) {
-            newX += speed;
-            direction = 3;
+        for (int i = 0; i <= LAST_CHAR - FIRST_CHAR; ++i) {
+            if (surfaces[i]) SDL_FreeSurface(surfaces[i]);
         }
 
-        SDL_Rect newRect = {static_cast<int>(newX), static_cast<int>(newY), width, height};
-        bool canMove = true;
+        if (!texture) {
+            std::cerr << "Failed to build glyph atlas: " << SDL_GetError() << std::endl;
+            return false;
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        return true;
+    }
 
-        for (const auto& wall : walls) {
-            if (SDL_HasIntersection(&newRect, &wall)) {
-                canMove = false;
-                break;
+    void appendText(TextMesh& mesh, const char* text, int x, int y, SDL_Color color) const {
+        if (!texture) return;
+        float penX = static_cast<float>(x);
+        for (const char* p = text; *p; ++p) {
+            int c = static_cast<unsigned char>(*p);
+            if (c < FIRST_CHAR || c > LAST_CHAR) c = '?';
+            const Glyph& glyph = glyphs[c - FIRST_CHAR];
+            if (glyph.src.w > 0) {
+                float u0 = static_cast<float>(glyph.src.x) / atlasWidth;
+                float v0 = static_cast<float>(glyph.src.y) / atlasHeight;
+                float u1 = static_cast<float>(glyph.src.x + glyph.src.w) / atlasWidth;
+                float v1 = static_cast<float>(glyph.src.y + glyph.src.h) / atlasHeight;
+                float x0 = penX, y0 = static_cast<float>(y);
+                float x1 = x0 + glyph.src.w, y1 = y0 + glyph.src.h;
+
+                int base = static_cast<int>(mesh.vertices.size());
+                mesh.vertices.push_back({{x0, y0}, color, {u0, v0}});
+                mesh.vertices.push_back({{x1, y0}, color, {u1, v0}});
+                mesh.vertices.push_back({{x1, y1}, color, {u1, v1}});
+                mesh.vertices.push_back({{x0, y1}, color, {u0, v1}});
+                int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+                mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
             }
+            penX += glyph.advance;
         }
+    }
 
-        if (otherPlayerRect && SDL_HasIntersection(&newRect, otherPlayerRect)) {
-            canMove = false;
-        }
+    void draw(SDL_Renderer* renderer, const TextMesh& mesh) const {
+        if (!texture || mesh.indices.empty()) return;
+        SDL_RenderGeometry(renderer, texture, mesh.vertices.data(), static_cast<int>(mesh.vertices.size()),
+                           mesh.indices.data(), static_cast<int>(mesh.indices.size()));
+    }
+};
 
-        if (canMove) {
-            x = newX;
-            y = newY;
-            rect.x = static_cast<int>(x);
-            rect.y = static_cast<int>(y);
-        }
+enum SpriteId {
+    SPRITE_PLAYER_TANK,
+    SPRITE_ENEMY_TANK,
+    SPRITE_BULLET,
+    SPRITE_BRICK,
+    SPRITE_STONE,
+    SPRITE_POWERUP,
+    SPRITE_WHITE,
+    SPRITE_COUNT
+};
 
-        if (rect.x < 0) rect.x = x = 0;
-        if (rect.y < 0) rect.y = y = 0;
-        if (rect.x > SCREEN_WIDTH - width) rect.x = x = SCREEN_WIDTH - width;
-        if (rect.y > SCREEN_HEIGHT - height) rect.y = y = SCREEN_HEIGHT - height;
+// All in-game sprites packed into one texture on first load, plus a small white patch for solid rectangles.
+class SpriteAtlas {
+public:
+    static constexpr int ATLAS_WIDTH = 512;
+    static const int WHITE_SIZE = 3;
 
-        updateInvincible();
+    SDL_Texture* texture;
+    SDL_Surface* pixels;
+    int atlasWidth;
+    int atlasHeight;
+    SDL_Rect regions[SPRITE_COUNT];
+    bool present[SPRITE_COUNT];
+
+    SpriteAtlas() : texture(nullptr), pixels(nullptr), atlasWidth(0), atlasHeight(0) {
+        std::memset(regions, 0, sizeof(regions));
+        std::memset(present, 0, sizeof(present));
     }
 
-    void shoot() {
-        bullets.emplace_back(renderer, rect.x + width / 2 - 5, rect.y + height / 2 - 5, direction);
-        if (shootSound) Mix_PlayChannel(-1, shootSound, 0);
+    ~SpriteAtlas() {
+        release();
     }
 
-    void updateBullets(std::vector<SDL_Rect>& walls, std::vector<bool>& wallBreakable) {
-        for (auto& bullet : bullets) bullet.update(walls, wallBreakable);
-        bullets.erase(std::remove_if(bullets.begin(), bullets.end(), [](Bullet& b) { return !b.active; }), bullets.end());
+    void release() {
+        if (texture) SDL_DestroyTexture(texture);
+        if (pixels) SDL_FreeSurface(pixels);
+        texture = nullptr;
+        pixels = nullptr;
+        std::memset(present, 0, sizeof(present));
     }
 
-    void renderHealthBar(bool isPlayer1 = true) {
-        SDL_Rect healthBarBg = {rect.x, rect.y - 10, width, 5};
-        SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-        SDL_RenderFillRect(renderer, &healthBarBg);
-
-        SDL_Rect healthBar = {rect.x, rect.y - 10, (int)(width * ((float)health / maxHealth)), 5};
-        if (isPlayer1) {
-            SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
-        } else {
-            SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
-        }
-        SDL_RenderFillRect(renderer, &healthBar);
+    bool has(SpriteId id) const {
+        return texture && present[id];
     }
 
-    void render(bool isPlayer1 = true) {
-        if (!alive || !tankTexture) return;
+    // Decodes and packs the images into pixels without touching the renderer, so it may run on a loader thread.
+    // paths[id] may be null for sprites without an image; ids sharing a path share one region.
+    bool pack(const char* const paths[SPRITE_COUNT], const AssetArchive& archive) {
+        release();
+        SDL_Surface* surfaces[SPRITE_COUNT] = {};
+        int source[SPRITE_COUNT];
+        int widest = WHITE_SIZE;
+        for (int id = 0; id < SPRITE_COUNT; ++id) {
+            source[id] = id;
+            if (!paths[id]) continue;
+            for (int prev = 0; prev < id; ++prev) {
+                if (paths[prev] && strcmp(paths[prev], paths[id]) == 0) source[id] = source[prev];
+            }
+            if (source[id] != id) continue;
 
-        if (invincible && (SDL_GetTicks() / 100) % 2 == 0) {
-            SDL_SetTextureAlphaMod(tankTexture, 128);
-        } else {
-            SDL_SetTextureAlphaMod(tankTexture, 255);
+            SDL_Surface* loaded = IMG_Load_RW(archive.openAsset(paths[id]), 1);
+            if (!loaded) {
+                std::cerr << "Failed to load sprite " << paths[id] << ": " << IMG_GetError() << std::endl;
+                continue;
+            }
+            surfaces[id] = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+            SDL_FreeSurface(loaded);
+            if (surfaces[id]) widest = std::max(widest, surfaces[id]->w);
         }
 
-        double angle;
-        switch (direction) {
-            case 0: angle = 0; break;
-            case 1: angle = 270; break;
-            case 2: angle = 180; break;
-            case 3: angle = 90; break;
-            default: angle = 0; break;
+        atlasWidth = std::max(ATLAS_WIDTH, widest);
+        int penX = 0, penY = 0, rowHeight = 0;
+        SDL_Rect white = {0, 0, WHITE_SIZE, WHITE_SIZE};
+        for (int id = 0; id <= SPRITE_COUNT; ++id) {
+            SDL_Rect* slot = id == SPRITE_COUNT ? &white : (surfaces[id] ? &regions[id] : nullptr);
+            if (!slot) continue;
+            if (id < SPRITE_COUNT) *slot = {0, 0, surfaces[id]->w, surfaces[id]->h};
+            if (penX + slot->w > atlasWidth) {
+                penX = 0;
+                penY += rowHeight + 1;
+                rowHeight = 0;
+            }
+            slot->x = penX;
+            slot->y = penY;
+            penX += slot->w + 1;
+            rowHeight = std::max(rowHeight, slot->h);
+        }
+        atlasHeight = penY + rowHeight;
+
+        pixels = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, atlasHeight, 32, SDL_PIXELFORMAT_RGBA32);
+        if (pixels) {
+            SDL_FillRect(pixels, &white, SDL_MapRGBA(pixels->format, 255, 255, 255, 255));
+            for (int id = 0; id < SPRITE_COUNT; ++id) {
+                if (!surfaces[id]) continue;
+                SDL_SetSurfaceBlendMode(surfaces[id], SDL_BLENDMODE_NONE);
+                SDL_Rect dst = regions[id];
+                SDL_BlitSurface(surfaces[id], nullptr, pixels, &dst);
+            }
+        }
+        for (int id = 0; id < SPRITE_COUNT; ++id) {
+            present[id] = surfaces[source[id]] != nullptr;
+            if (source[id] != id) regions[id] = regions[source[id]];
         }
+        for (int id = 0; id < SPRITE_COUNT; ++id) {
+            if (surfaces[id]) SDL_FreeSurface(surfaces[id]);
+        }
+        // Sample only the centre texel so filtering never picks up neighbouring sprites.
+        regions[SPRITE_WHITE] = {white.x + WHITE_SIZE / 2, white.y + WHITE_SIZE / 2, 1, 1};
+        present[SPRITE_WHITE] = true;
+        return pixels != nullptr;
+    }
 
-        SDL_RenderCopyEx(renderer, tankTexture, nullptr, &rect, angle, nullptr, SDL_FLIP_NONE);
-        renderHealthBar(isPlayer1);
-        for (auto& bullet : bullets) bullet.render();
+    // Creates the texture from the packed pixels; must run on the render thread.
+    bool upload(SDL_Renderer* renderer) {
+        if (!pixels) return false;
+        texture = SDL_CreateTextureFromSurface(renderer, pixels);
+        SDL_FreeSurface(pixels);
+        pixels = nullptr;
+        if (!texture) {
+            std::cerr << "Failed to build sprite atlas: " << SDL_GetError() << std::endl;
+            return false;
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        return true;
     }
 };
 
-class EnemyTank {
+// Collects every sprite quad of a frame so they can be submitted with a single SDL_RenderGeometry call.
+class SpriteBatch {
 public:
-    SDL_Rect rect;
-    SDL_Renderer* renderer;
-    std::vector<Bullet> bullets;
-    bool alive;
-    int direction;
-    int moveTimer;
-    int moveDuration;
-    int moveSpeed;
-    PlayerTank* target;
-    int shootCooldown;
-    bool frozen;
-    Uint32 freezeEndTime;
-    SDL_Texture* tankTexture;
-    Mix_Chunk* shootSound;
-    Mix_Chunk* explosionSound;
+    const SpriteAtlas* atlas;
+    SDL_Point origin;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+
+    SpriteBatch() : atlas(nullptr), origin({0, 0}) {}
+
+    // Destination rects are in world coordinates; origin is the world point drawn at the render target's top-left.
+    void begin(const SpriteAtlas& spriteAtlas, SDL_Point worldOrigin = {0, 0}) {
+        atlas = &spriteAtlas;
+        origin = worldOrigin;
+        vertices.clear();
+        indices.clear();
+    }
 
-    EnemyTank(SDL_Renderer* rend, int x, int y, PlayerTank* player, Mix_Chunk* shootSnd, Mix_Chunk* explodeSnd) :
-        renderer(rend), alive(true), frozen(false), freezeEndTime(0), tankTexture(nullptr),
-        shootSound(shootSnd), explosionSound(explodeSnd) {
-        rect = {x, y, GRID_SIZE, GRID_SIZE};
-        direction = rand() % 4;
-        moveTimer = 0;
-        moveDuration = 50;
-        moveSpeed = 2;
-        target = player;
-        shootCooldown = 0;
-
-        SDL_Surface* surface = IMG_Load("tankenemy.png");
-        if (!surface) {
-            std::cerr << "Failed to load enemy tank texture: " << IMG_GetError() << std::endl;
-        } else {
-            tankTexture = SDL_CreateTextureFromSurface(renderer, surface);
-            SDL_FreeSurface(surface);
+    // Rotates clockwise by angle degrees around the centre of dst, like SDL_RenderCopyEx.
+    void draw(SpriteId id, const SDL_Rect& dst, SDL_Color color = {255, 255, 255, 255}, double angle = 0) {
+        if (!atlas || !atlas->has(id)) return;
+        const SDL_Rect& src = atlas->regions[id];
+        float u0 = static_cast<float>(src.x) / atlas->atlasWidth;
+        float v0 = static_cast<float>(src.y) / atlas->atlasHeight;
+        float u1 = static_cast<float>(src.x + src.w) / atlas->atlasWidth;
+        float v1 = static_cast<float>(src.y + src.h) / atlas->atlasHeight;
+
+        float halfW = dst.w * 0.5f, halfH = dst.h * 0.5f;
+        float centerX = dst.x - origin.x + halfW, centerY = dst.y - origin.y + halfH;
+        float radians = static_cast<float>(angle * 3.14159265358979323846 / 180.0);
+        float c = angle == 0 ? 1.0f : std::cos(radians);
+        float s = angle == 0 ? 0.0f : std::sin(radians);
+        const float cornerX[4] = {-halfW, halfW, halfW, -halfW};
+        const float cornerY[4] = {-halfH, -halfH, halfH, halfH};
+        const float cornerU[4] = {u0, u1, u1, u0};
+        const float cornerV[4] = {v0, v0, v1, v1};
+
+        int base = static_cast<int>(vertices.size());
+        for (int k = 0; k < 4; ++k) {
+            SDL_FPoint position = {centerX + cornerX[k] * c - cornerY[k] * s, centerY + cornerX[k] * s + cornerY[k] * c};
+            vertices.push_back({position, color, {cornerU[k], cornerV[k]}});
         }
+        int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+        indices.insert(indices.end(), quad, quad + 6);
     }
 
-    ~EnemyTank() {
-        if (tankTexture) SDL_DestroyTexture(tankTexture);
+    void fillRect(const SDL_Rect& dst, SDL_Color color) {
+        draw(SPRITE_WHITE, dst, color);
     }
 
-    void freeze(Uint32 duration) {
-        frozen = true;
-        freezeEndTime = SDL_GetTicks() + duration;
+    // Draws cell (partCol, partRow) of the sprite cut into parts x parts equal cells.
+    void drawPart(SpriteId id, const SDL_Rect& dst, int partCol, int partRow, int parts) {
+        if (!atlas || !atlas->has(id)) return;
+        const SDL_Rect& src = atlas->regions[id];
+        float u0 = (src.x + static_cast<float>(src.w) * partCol / parts) / atlas->atlasWidth;
+        float v0 = (src.y + static_cast<float>(src.h) * partRow / parts) / atlas->atlasHeight;
+        float u1 = (src.x + static_cast<float>(src.w) * (partCol + 1) / parts) / atlas->atlasWidth;
+        float v1 = (src.y + static_cast<float>(src.h) * (partRow + 1) / parts) / atlas->atlasHeight;
+        float x0 = static_cast<float>(dst.x - origin.x), y0 = static_cast<float>(dst.y - origin.y);
+        float x1 = x0 + dst.w, y1 = y0 + dst.h;
+        SDL_Color white = {255, 255, 255, 255};
+
+        int base = static_cast<int>(vertices.size());
+        vertices.push_back({{x0, y0}, white, {u0, v0}});
+        vertices.push_back({{x1, y0}, white, {u1, v0}});
+        vertices.push_back({{x1, y1}, white, {u1, v1}});
+        vertices.push_back({{x0, y1}, white, {u0, v1}});
+        int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+        indices.insert(indices.end(), quad, quad + 6);
     }
 
-    void updateFreeze() {
-        if (frozen && SDL_GetTicks() > freezeEndTime) {
-            frozen = false;
+    void flush(SDL_Renderer* renderer) {
+        if (atlas && atlas->texture && !indices.empty()) {
+            SDL_RenderGeometry(renderer, atlas->texture, vertices.data(), static_cast<int>(vertices.size()),
+                               indices.data(), static_cast<int>(indices.size()));
         }
+        vertices.clear();
+        indices.clear();
     }
+};
 
-    bool checkCollision(int newX, int newY, const std::vector<SDL_Rect>& walls) {
-        SDL_Rect newPos = {newX, newY, GRID_SIZE, GRID_SIZE};
-        for (const auto& wall : walls) {
-            if (SDL_HasIntersection(&newPos, &wall)) return true;
+// Terrain is pre-rendered in chunks of CHUNK_TILES x CHUNK_TILES tiles. Only chunks in view hold a texture, taken
+// from a small pool and fully redrawn when assigned, so texture memory and redraw work follow the viewport rather
+// than the map size. Brick hits in a chunk that already has a texture redraw just their tile.
+class TerrainLayer {
+public:
+    static const int CHUNK_TILES = 16;
+    static const int CHUNK_PIXELS = CHUNK_TILES * GRID_SIZE;
+    static const int CHUNK_ROWS = (MAP_ROWS + CHUNK_TILES - 1) / CHUNK_TILES;
+    static const int CHUNK_COLS = (MAP_COLS + CHUNK_TILES - 1) / CHUNK_TILES;
+    static const int MAX_TEXTURES = 16;
+
+    struct Chunk {
+        int texture;
+        bool fullRedraw;
+        Uint32 lastUsed;
+        std::vector<SDL_Point> dirtyTiles;
+    };
+
+    struct ChunkTexture {
+        SDL_Texture* texture;
+        int chunk;
+    };
+
+    std::vector<Chunk> chunks;
+    std::vector<ChunkTexture> textures;
+    std::vector<Uint8> dirty;
+    Uint32 frame;
+
+    TerrainLayer() : chunks(CHUNK_ROWS * CHUNK_COLS), dirty(MAP_ROWS * MAP_COLS, 0), frame(0) {
+        for (Chunk& chunk : chunks) {
+            chunk.texture = -1;
+            chunk.fullRedraw = true;
+            chunk.lastUsed = 0;
         }
-        return false;
     }
 
-    void update(std::vector<SDL_Rect>& walls, std::vector<bool>& wallBreakable) {
-        if (!alive || frozen) return;
-
-    if (!target || !target->alive) {
+    ~TerrainLayer() {
+        release();
+    }
 
-        moveTimer++;
-        if (moveTimer >= moveDuration) {
-            direction = rand() % 4;
-            moveTimer = 0;
+    void release() {
+        for (ChunkTexture& entry : textures) {
+            if (entry.texture) SDL_DestroyTexture(entry.texture);
+            if (entry.chunk >= 0) chunks[entry.chunk].texture = -1;
         }
-        move(direction, walls);
-        return;
+        textures.clear();
+        invalidateAll();
     }
 
-        moveTimer++;
-        if (moveTimer >= moveDuration) {
-            chooseDirectionTowardsPlayer();
-            moveTimer = 0;
+    void invalidateAll() {
+        for (Chunk& chunk : chunks) {
+            chunk.fullRedraw = true;
+            for (const SDL_Point& tile : chunk.dirtyTiles) dirty[tile.y * MAP_COLS + tile.x] = 0;
+            chunk.dirtyTiles.clear();
         }
+    }
 
-        move(direction, walls);
-
-        if (shootCooldown > 0) shootCooldown--;
+    void markDirty(int row, int col) {
+        Chunk& chunk = chunks[(row / CHUNK_TILES) * CHUNK_COLS + col / CHUNK_TILES];
+        if (chunk.texture < 0 || chunk.fullRedraw || dirty[row * MAP_COLS + col]) return;
+        dirty[row * MAP_COLS + col] = 1;
+        chunk.dirtyTiles.push_back({col, row});
+    }
 
-        int distanceX = abs(rect.x - target->rect.x);
-        int distanceY = abs(rect.y - target->rect.y);
-        int shootThreshold = 200;
-        if (distanceX + distanceY < shootThreshold && rand() % 100 < 10 && shootCooldown == 0) {
-            shoot();
-            shootCooldown = 60;
+    // Partly destroyed bricks are drawn one quad per remaining sub-cell.
+    void drawTile(SpriteBatch& batch, const Uint8 map[MAP_ROWS][MAP_COLS], const Uint16 masks[MAP_ROWS][MAP_COLS],
+                  int row, int col) {
+        SDL_Rect tile = {col * GRID_SIZE, row * GRID_SIZE, GRID_SIZE, GRID_SIZE};
+        if (map[row][col] == 1) {
+            batch.draw(SPRITE_STONE, tile);
+        } else if (map[row][col] == 2) {
+            Uint16 mask = masks[row][col];
+            if (mask == 0xFFFF) {
+                batch.draw(SPRITE_BRICK, tile);
+                return;
+            }
+            const int cellSize = GRID_SIZE / 4;
+            for (int bit = 0; bit < 16; ++bit) {
+                if (!(mask & (1 << bit))) continue;
+                SDL_Rect cell = {tile.x + (bit % 4) * cellSize, tile.y + (bit / 4) * cellSize, cellSize, cellSize};
+                batch.drawPart(SPRITE_BRICK, cell, bit % 4, bit / 4, 4);
+            }
         }
-
-        for (auto& bullet : bullets) bullet.update(walls, wallBreakable);
-        bullets.erase(std::remove_if(bullets.begin(), bullets.end(), [](Bullet& b) { return !b.active; }), bullets.end());
     }
 
-    void chooseDirectionTowardsPlayer() {
-        if (!target) return;
+    // Chunk range [first, last] covering a world-space rect, clamped to the map.
+    static void chunkRange(const SDL_Rect& view, int& firstRow, int& lastRow, int& firstCol, int& lastCol) {
+        firstCol = std::max(0, view.x / CHUNK_PIXELS);
+        firstRow = std::max(0, view.y / CHUNK_PIXELS);
+        lastCol = std::min(CHUNK_COLS - 1, (view.x + view.w - 1) / CHUNK_PIXELS);
+        lastRow = std::min(CHUNK_ROWS - 1, (view.y + view.h - 1) / CHUNK_PIXELS);
+    }
 
-        int deltaX = rect.x - target->rect.x;
-        int deltaY = rect.y - target->rect.y;
+    // Called once per frame before update(); chunks touched since then are not evicted this frame.
+    void beginFrame() {
+        frame++;
+    }
 
-        if (abs(deltaX) > abs(deltaY)) {
-            direction = deltaX > 0 ? 1 : 3;
+    bool acquireTexture(SDL_Renderer* renderer, int index) {
+        int slot = -1;
+        if (static_cast<int>(textures.size()) < MAX_TEXTURES) {
+            SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                                     CHUNK_PIXELS, CHUNK_PIXELS);
+            if (!texture) {
+                std::cerr << "Failed to create terrain chunk: " << SDL_GetError() << std::endl;
+                return false;
+            }
+            SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+            textures.push_back({texture, -1});
+            slot = static_cast<int>(textures.size()) - 1;
         } else {
-            direction = deltaY > 0 ? 0 : 2;
+            Uint32 oldest = frame;
+            for (size_t i = 0; i < textures.size(); ++i) {
+                int owner = textures[i].chunk;
+                if (owner < 0) {
+                    slot = static_cast<int>(i);
+                    break;
+                }
+                if (chunks[owner].lastUsed != frame && (slot < 0 || frame - chunks[owner].lastUsed > frame - oldest)) {
+                    slot = static_cast<int>(i);
+                    oldest = chunks[owner].lastUsed;
+                }
+            }
+            if (slot < 0) return false;
+            int owner = textures[slot].chunk;
+            if (owner >= 0) {
+                Chunk& evicted = chunks[owner];
+                evicted.texture = -1;
+                for (const SDL_Point& tile : evicted.dirtyTiles) dirty[tile.y * MAP_COLS + tile.x] = 0;
+                evicted.dirtyTiles.clear();
+            }
         }
-
-        if (rand() % 100 < 20) direction = rand() % 4;
+        textures[slot].chunk = index;
+        chunks[index].texture = slot;
+        chunks[index].fullRedraw = true;
+        return true;
     }
 
-    void move(int dir, const std::vector<SDL_Rect>& walls) {
-        if (frozen) return;
-
-        direction = dir;
-        int newX = rect.x + (dir == 1 ? -moveSpeed : dir == 3 ? moveSpeed : 0);
-        int newY = rect.y + (dir == 0 ? -moveSpeed : dir == 2 ? moveSpeed : 0);
+    // Brings every chunk intersecting view (world coordinates) up to date. Must run before any viewport is set,
+    // since switching render targets resets it.
+    void update(SDL_Renderer* renderer, const Uint8 map[MAP_ROWS][MAP_COLS], const Uint16 masks[MAP_ROWS][MAP_COLS],
+                const SpriteAtlas& atlas, SpriteBatch& batch, const SDL_Rect& view) {
+        if (!renderer) return;
+        int firstRow, lastRow, firstCol, lastCol;
+        chunkRange(view, firstRow, lastRow, firstCol, lastCol);
+        bool targetSet = false;
+        for (int chunkRow = firstRow; chunkRow <= lastRow; ++chunkRow) {
+            for (int chunkCol = firstCol; chunkCol <= lastCol; ++chunkCol) {
+                int index = chunkRow * CHUNK_COLS + chunkCol;
+                Chunk& chunk = chunks[index];
+                chunk.lastUsed = frame;
+                if (chunk.texture < 0 && !acquireTexture(renderer, index)) continue;
+                if (!chunk.fullRedraw && chunk.dirtyTiles.empty()) continue;
+
+                SDL_SetRenderTarget(renderer, textures[chunk.texture].texture);
+                targetSet = true;
+                SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+                SDL_Point origin = {chunkCol * CHUNK_PIXELS, chunkRow * CHUNK_PIXELS};
+                batch.begin(atlas, origin);
+                if (chunk.fullRedraw) {
+                    SDL_RenderClear(renderer);
+                    int rowEnd = std::min(MAP_ROWS, (chunkRow + 1) * CHUNK_TILES);
+                    int colEnd = std::min(MAP_COLS, (chunkCol + 1) * CHUNK_TILES);
+                    for (int row = chunkRow * CHUNK_TILES; row < rowEnd; ++row) {
+                        for (int col = chunkCol * CHUNK_TILES; col < colEnd; ++col) {
+                            drawTile(batch, map, masks, row, col);
+                        }
+                    }
+                } else {
+                    for (const SDL_Point& tile : chunk.dirtyTiles) {
+                        SDL_Rect rect = {tile.x * GRID_SIZE - origin.x, tile.y * GRID_SIZE - origin.y, GRID_SIZE,
+                                         GRID_SIZE};
+                        SDL_RenderFillRect(renderer, &rect);
+                        drawTile(batch, map, masks, tile.y, tile.x);
+                    }
+                }
+                batch.flush(renderer);
 
-        if (newX >= 0 && newX + GRID_SIZE <= SCREEN_WIDTH && newY >= 0 && newY + GRID_SIZE <= SCREEN_HEIGHT) {
-            if (!checkCollision(newX, newY, walls)) {
-                rect.x = newX;
-                rect.y = newY;
-            } else {
-                chooseDirectionTowardsPlayer();
+                for (const SDL_Point& tile : chunk.dirtyTiles) dirty[tile.y * MAP_COLS + tile.x] = 0;
+                chunk.dirtyTiles.clear();
+                chunk.fullRedraw = false;
             }
-        } else {
-            chooseDirectionTowardsPlayer();
         }
+        if (targetSet) SDL_SetRenderTarget(renderer, nullptr);
     }
 
-    void shoot() {
-        if (frozen) return;
-        bullets.emplace_back(renderer, rect.x + GRID_SIZE / 2 - 5, rect.y + GRID_SIZE / 2 - 5, direction);
-        if (shootSound) Mix_PlayChannel(-1, shootSound, 0);
+    // Draws the chunks under view into the current viewport, whose top-left shows world point (view.x, view.y).
+    void render(SDL_Renderer* renderer, const SDL_Rect& view) {
+        int firstRow, lastRow, firstCol, lastCol;
+        chunkRange(view, firstRow, lastRow, firstCol, lastCol);
+        for (int chunkRow = firstRow; chunkRow <= lastRow; ++chunkRow) {
+            for (int chunkCol = firstCol; chunkCol <= lastCol; ++chunkCol) {
+                const Chunk& chunk = chunks[chunkRow * CHUNK_COLS + chunkCol];
+                if (chunk.texture < 0 || chunk.fullRedraw) continue;
+                SDL_Rect dst = {chunkCol * CHUNK_PIXELS - view.x, chunkRow * CHUNK_PIXELS - view.y, CHUNK_PIXELS,
+                                CHUNK_PIXELS};
+                SDL_RenderCopy(renderer, textures[chunk.texture].texture, nullptr, &dst);
+            }
+        }
     }
+};
 
-    void render() {
-        if (!alive || !tankTexture) return;
+class Random {
+public:
+    Uint64 state;
 
-        if (frozen) {
-            SDL_SetTextureAlphaMod(tankTexture, 128);
-        } else {
-            SDL_SetTextureAlphaMod(tankTexture, 255);
-        }
+    Random(Uint32 seedValue = 1) {
+        seed(seedValue);
+    }
 
-        double angle;
-        switch (direction) {
-            case 0: angle = 0; break;
-            case 1: angle = 270; break;
-            case 2: angle = 180; break;
-            case 3: angle = 90; break;
-            default: angle = 0; break;
-        }
+    void seed(Uint32 seedValue) {
+        state = seedValue * 0x9E3779B97F4A7C15ull + 1442695040888963407ull;
+        next();
+    }
 
-        SDL_RenderCopyEx(renderer, tankTexture, nullptr, &rect, angle, nullptr, SDL_FLIP_NONE);
-        for (auto& bullet : bullets) bullet.render();
+    Uint32 next() {
+        Uint64 old = state;
+        state = old * 6364136223846793005ull + 1442695040888963407ull;
+        Uint32 xorshifted = static_cast<Uint32>(((old >> 18) ^ old) >> 27);
+        Uint32 rot = static_cast<Uint32>(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
     }
-};
 
-class Game {
-private:
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    bool running;
-    std::vector<SDL_Rect> walls;
-    std::vector<bool> wallBreakable;
-    int map[MAP_ROWS][MAP_COLS];
-    PlayerTank* player1;
-    PlayerTank* player2;
-    std::vector<EnemyTank*> enemies;
-    GameState state;
-    PowerUp powerUp;
-    Uint32 lastPowerUpSpawnTime;
-    const Uint32 powerUpSpawnInterval = 20000;
+    int nextInt(int bound) {
+        return static_cast<int>(next() % static_cast<Uint32>(bound));
+    }
+};
+
+enum GameState {
+    STATE_MENU,
+    STATE_1P,
+    STATE_2P,
+    STATE_GAME_OVER,
+    STATE_LOADING
+};
+
+enum PowerUpType {
+    POWERUP_NONE,
+    POWERUP_HEALTH,
+    POWERUP_FREEZE,
+    POWERUP_INVINCIBLE,
+    POWERUP_BOMB
+};
+
+class PowerUp {
+public:
+    SDL_Rect rect;
+    PowerUpType type;
+    bool active;
+    Uint32 spawnTime;
+    static const Uint32 duration = 10000;
+
+    PowerUp() : type(POWERUP_NONE), active(false) {
+        rect = {0, 0, GRID_SIZE, GRID_SIZE};
+    }
+
+    void spawn(int x, int y, PowerUpType t, Uint32 now) {
+        rect.x = x;
+        rect.y = y;
+        type = t;
+        active = true;
+        spawnTime = now;
+    }
+
+    void update(Uint32 now) {
+        if (!active) return;
+        if (now - spawnTime > duration) {
+            active = false;
+        }
+    }
+
+    void render(SpriteBatch& batch) {
+        if (!active) return;
+        if (batch.atlas && batch.atlas->has(SPRITE_POWERUP)) {
+            batch.draw(SPRITE_POWERUP, rect);
+        } else {
+            SDL_Color color;
+            switch (type) {
+                case POWERUP_HEALTH: color = {0, 255, 0, 255}; break;
+                case POWERUP_FREEZE: color = {0, 255, 255, 255}; break;
+                case POWERUP_INVINCIBLE: color = {255, 255, 0, 255}; break;
+                case POWERUP_BOMB: color = {255, 0, 255, 255}; break;
+                default: return;
+            }
+            batch.fillRect(rect, color);
+        }
+    }
+};
+
+struct WallHit {
+    int row;
+    int col;
+    Uint16 cells;
+};
+
+// Each tile is a 4x4 grid of sub-cells packed into a Uint16 (bit = subRow * 4 + subCol), so collision is an AND
+// between a tile's mask and the sub-cells a rect covers.
+class CollisionGrid {
+public:
+    static const int SUBCELLS = 4;
+    static const int SUBCELL_SIZE = GRID_SIZE / SUBCELLS;
+    static const Uint16 FULL_TILE = 0xFFFF;
+
+    Uint16 mask[MAP_ROWS][MAP_COLS];
+
+    CollisionGrid() {
+        std::memset(mask, 0, sizeof(mask));
+    }
+
+    void build(const Uint8 map[MAP_ROWS][MAP_COLS]) {
+        for (int row = 0; row < MAP_ROWS; ++row) {
+            for (int col = 0; col < MAP_COLS; ++col) {
+                mask[row][col] = (map[row][col] == 1 || map[row][col] == 2) ? FULL_TILE : 0;
+            }
+        }
+    }
+
+    bool isBlocked(int row, int col) const {
+        return mask[row][col] != 0;
+    }
+
+    // Clears the given sub-cells and returns whether the tile is now completely open.
+    bool clearCells(int row, int col, Uint16 cells) {
+        if (row < 0 || row >= MAP_ROWS || col < 0 || col >= MAP_COLS) return false;
+        mask[row][col] &= ~cells;
+        return mask[row][col] == 0;
+    }
+
+    // Sub-cells of tile (row, col) covered by rect, which must overlap the tile.
+    static Uint16 coverage(const SDL_Rect& rect, int row, int col) {
+        int tileX = col * GRID_SIZE, tileY = row * GRID_SIZE;
+        int sx0 = (std::max(rect.x, tileX) - tileX) / SUBCELL_SIZE;
+        int sx1 = (std::min(rect.x + rect.w, tileX + GRID_SIZE) - 1 - tileX) / SUBCELL_SIZE;
+        int sy0 = (std::max(rect.y, tileY) - tileY) / SUBCELL_SIZE;
+        int sy1 = (std::min(rect.y + rect.h, tileY + GRID_SIZE) - 1 - tileY) / SUBCELL_SIZE;
+        Uint32 columns = ((1u << (sx1 + 1)) - (1u << sx0)) * 0x1111u;
+        Uint32 rows = (1u << ((sy1 + 1) * 4)) - (1u << (sy0 * 4));
+        return static_cast<Uint16>(columns & rows);
+    }
+
+    static int tileOf(int pixel) {
+        return pixel >= 0 ? pixel / GRID_SIZE : (pixel - GRID_SIZE + 1) / GRID_SIZE;
+    }
+
+    // Calls fn(row, col, cells) for every tile where rect covers solid sub-cells.
+    template <typename Fn>
+    void forEachSolidTile(const SDL_Rect& rect, Fn fn) const {
+        if (rect.w <= 0 || rect.h <= 0) return;
+        int col0 = std::max(0, tileOf(rect.x));
+        int col1 = std::min(MAP_COLS - 1, tileOf(rect.x + rect.w - 1));
+        int row0 = std::max(0, tileOf(rect.y));
+        int row1 = std::min(MAP_ROWS - 1, tileOf(rect.y + rect.h - 1));
+        for (int row = row0; row <= row1; ++row) {
+            for (int col = col0; col <= col1; ++col) {
+                if (!mask[row][col]) continue;
+                Uint16 cells = mask[row][col] & coverage(rect, row, col);
+                if (cells) fn(row, col, cells);
+            }
+        }
+    }
+
+    bool overlapsSolid(const SDL_Rect& rect) const {
+        if (rect.w <= 0 || rect.h <= 0) return false;
+        int col0 = std::max(0, tileOf(rect.x));
+        int col1 = std::min(MAP_COLS - 1, tileOf(rect.x + rect.w - 1));
+        int row0 = std::max(0, tileOf(rect.y));
+        int row1 = std::min(MAP_ROWS - 1, tileOf(rect.y + rect.h - 1));
+        for (int row = row0; row <= row1; ++row) {
+            for (int col = col0; col <= col1; ++col) {
+                if (mask[row][col] && (mask[row][col] & coverage(rect, row, col))) return true;
+            }
+        }
+        return false;
+    }
+};
+
+class FlowField {
+public:
+    static constexpr Uint16 UNREACHABLE = 0xFFFF;
+
+    Uint16 distance[MAP_ROWS][MAP_COLS];
+    Uint32 queue[MAP_ROWS * MAP_COLS];
+    int sourceRow;
+    int sourceCol;
+    Uint32 terrainRevision;
+    bool valid;
+
+    FlowField() : sourceRow(-1), sourceCol(-1), terrainRevision(0), valid(false) {}
+
+    bool isCurrent(int row, int col, Uint32 revision) const {
+        return valid && row == sourceRow && col == sourceCol && revision == terrainRevision;
+    }
+
+    void compute(const CollisionGrid& grid, int row, int col, Uint32 revision) {
+        static const int stepRow[4] = {-1, 0, 1, 0};
+        static const int stepCol[4] = {0, -1, 0, 1};
+
+        std::fill(&distance[0][0], &distance[0][0] + MAP_ROWS * MAP_COLS, UNREACHABLE);
+        sourceRow = row;
+        sourceCol = col;
+        terrainRevision = revision;
+        valid = true;
+        if (row < 0 || row >= MAP_ROWS || col < 0 || col >= MAP_COLS) return;
+
+        int head = 0, tail = 0;
+        distance[row][col] = 0;
+        queue[tail++] = static_cast<Uint32>(row * MAP_COLS + col);
+        while (head < tail) {
+            int r = queue[head] / MAP_COLS;
+            int c = queue[head] % MAP_COLS;
+            head++;
+            Uint16 next = distance[r][c] + 1;
+            if (next == UNREACHABLE) continue;
+            for (int d = 0; d < 4; ++d) {
+                int nr = r + stepRow[d];
+                int nc = c + stepCol[d];
+                if (nr < 0 || nr >= MAP_ROWS || nc < 0 || nc >= MAP_COLS) continue;
+                if (grid.isBlocked(nr, nc) || distance[nr][nc] != UNREACHABLE) continue;
+                distance[nr][nc] = next;
+                queue[tail++] = static_cast<Uint32>(nr * MAP_COLS + nc);
+            }
+        }
+    }
+
+    // Returns the direction (0 up, 1 left, 2 down, 3 right) of the neighbouring tile closest to the
+    // source, preferring the current heading on ties, or -1 if no neighbour gets closer.
+    int directionFrom(int row, int col, int currentDirection) const {
+        static const int stepRow[4] = {-1, 0, 1, 0};
+        static const int stepCol[4] = {0, -1, 0, 1};
+        if (!valid || row < 0 || row >= MAP_ROWS || col < 0 || col >= MAP_COLS) return -1;
+
+        int best = -1;
+        Uint16 bestDistance = distance[row][col];
+        for (int k = 0; k < 4; ++k) {
+            int d = (currentDirection + k) & 3;
+            int nr = row + stepRow[d];
+            int nc = col + stepCol[d];
+            if (nr < 0 || nr >= MAP_ROWS || nc < 0 || nc >= MAP_COLS) continue;
+            if (distance[nr][nc] < bestDistance) {
+                bestDistance = distance[nr][nc];
+                best = d;
+            }
+        }
+        return best;
+    }
+};
+
+class SpatialGrid {
+public:
+    static const int CELL_COUNT = MAP_ROWS * MAP_COLS;
+
+    // Only occupied cells are touched per build, so the cost follows the item count rather than the map area.
+    // Counts of cells not in occupiedCells are zero; their starts are stale and never read.
+    int cellStart[CELL_COUNT];
+    int cellCount[CELL_COUNT];
+    std::vector<int> fill;
+    std::vector<int> occupiedCells;
+    std::vector<int> cellItems;
+    std::vector<int> itemCells;
+
+    SpatialGrid() : fill(CELL_COUNT, 0) {
+        std::memset(cellCount, 0, sizeof(cellCount));
+    }
+
+    static int cellOf(int x, int y) {
+        int col = std::min(MAP_COLS - 1, std::max(0, CollisionGrid::tileOf(x)));
+        int row = std::min(MAP_ROWS - 1, std::max(0, CollisionGrid::tileOf(y)));
+        return row * MAP_COLS + col;
+    }
+
+    // Items are bucketed by the cell of their top-left corner and must be at most GRID_SIZE wide.
+    template <typename PositionFn>
+    void build(int count, PositionFn positionOf) {
+        for (int cell : occupiedCells) cellCount[cell] = 0;
+        occupiedCells.clear();
+        itemCells.resize(count);
+        cellItems.resize(count);
+        for (int i = 0; i < count; ++i) {
+            SDL_Point p = positionOf(i);
+            int cell = cellOf(p.x, p.y);
+            itemCells[i] = cell;
+            if (cellCount[cell]++ == 0) occupiedCells.push_back(cell);
+        }
+        int start = 0;
+        for (int cell : occupiedCells) {
+            cellStart[cell] = fill[cell] = start;
+            start += cellCount[cell];
+        }
+        for (int i = 0; i < count; ++i) cellItems[fill[itemCells[i]]++] = i;
+    }
+
+    template <typename Fn>
+    void query(const SDL_Rect& rect, Fn fn) const {
+        int col0 = std::max(0, CollisionGrid::tileOf(rect.x) - 1);
+        int col1 = std::min(MAP_COLS - 1, CollisionGrid::tileOf(rect.x + rect.w - 1));
+        int row0 = std::max(0, CollisionGrid::tileOf(rect.y) - 1);
+        int row1 = std::min(MAP_ROWS - 1, CollisionGrid::tileOf(rect.y + rect.h - 1));
+        for (int row = row0; row <= row1; ++row) {
+            for (int col = col0; col <= col1; ++col) {
+                int cell = row * MAP_COLS + col;
+                for (int k = cellStart[cell], end = k + cellCount[cell]; k < end; ++k) fn(cellItems[k]);
+            }
+        }
+    }
+};
+
+// Whole pixels covered during tick number tick by something moving pixelsPerSecond. The steps add up to the
+// exact distance, so movement keeps the same speed at any tick rate.
+inline int stepDistance(int pixelsPerSecond, Uint32 tick, int tickRate) {
+    Uint64 before = static_cast<Uint64>(pixelsPerSecond) * tick / tickRate;
+    Uint64 after = static_cast<Uint64>(pixelsPerSecond) * (tick + 1) / tickRate;
+    return static_cast<int>(after - before);
+}
+
+inline Uint32 fnv1a(const Uint8* data, size_t size, Uint32 hash = 2166136261u) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Milliseconds to the nearest whole number of ticks.
+inline int ticksFor(int milliseconds, int tickRate) {
+    return (milliseconds * tickRate + 500) / 1000;
+}
+
+inline int lerpInt(int from, int to, float alpha) {
+    return from + static_cast<int>((to - from) * alpha + (to >= from ? 0.5f : -0.5f));
+}
+
+inline bool intersects(const SDL_Rect& view, int x, int y, int w, int h) {
+    return x < view.x + view.w && x + w > view.x && y < view.y + view.h && y + h > view.y;
+}
+
+const int MAX_BULLETS = 4096;
+const int BULLET_SIZE = 10;
+const int BULLET_SPEED = 300;  // pixels per second
+
+enum BulletOwner {
+    OWNER_PLAYER1,
+    OWNER_PLAYER2,
+    OWNER_ENEMY
+};
+
+inline int lowestSetBit(Uint64 bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+// Snapshot helpers: raw copies of plain arrays into and out of a byte buffer.
+template <typename T>
+inline void appendBytes(std::vector<Uint8>& out, const T* data, int count) {
+    const Uint8* bytes = reinterpret_cast<const Uint8*>(data);
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+template <typename T>
+inline void takeBytes(const Uint8*& in, T* data, int count) {
+    memcpy(data, in, count * sizeof(T));
+    in += count * sizeof(T);
+}
+
+class BulletPool {
+public:
+    static const int MASK_WORDS = MAX_BULLETS / 64;
+
+    int x[MAX_BULLETS];
+    int y[MAX_BULLETS];
+    int prevX[MAX_BULLETS];
+    int prevY[MAX_BULLETS];
+    Sint8 dx[MAX_BULLETS];
+    Sint8 dy[MAX_BULLETS];
+    Uint8 owner[MAX_BULLETS];
+    Uint64 activeMask[MASK_WORDS];
+    Uint16 freeList[MAX_BULLETS];
+    int freeCount;
+    int activeCount;
+    // Slots below this have been handed out since clear(). The bottom MAX_BULLETS - highWater entries of
+    // freeList are still the untouched initial sequence, so only what lies above them needs saving.
+    int highWater;
+
+    BulletPool() {
+        clear();
+    }
+
+    void clear() {
+        std::memset(activeMask, 0, sizeof(activeMask));
+        for (int i = 0; i < MAX_BULLETS; ++i) {
+            freeList[i] = static_cast<Uint16>(MAX_BULLETS - 1 - i);
+        }
+        freeCount = MAX_BULLETS;
+        activeCount = 0;
+        highWater = 0;
+    }
+
+    void saveTo(std::vector<Uint8>& out) const {
+        int header[3] = {freeCount, activeCount, highWater};
+        appendBytes(out, header, 3);
+        appendBytes(out, x, highWater);
+        appendBytes(out, y, highWater);
+        appendBytes(out, prevX, highWater);
+        appendBytes(out, prevY, highWater);
+        appendBytes(out, dx, highWater);
+        appendBytes(out, dy, highWater);
+        appendBytes(out, owner, highWater);
+        appendBytes(out, activeMask, (highWater + 63) / 64);
+        appendBytes(out, freeList + MAX_BULLETS - highWater, freeCount - (MAX_BULLETS - highWater));
+    }
+
+    void restoreFrom(const Uint8*& in) {
+        int header[3];
+        takeBytes(in, header, 3);
+        int oldWords = (highWater + 63) / 64;
+        int oldUntouched = MAX_BULLETS - highWater;
+        freeCount = header[0];
+        activeCount = header[1];
+        highWater = header[2];
+        takeBytes(in, x, highWater);
+        takeBytes(in, y, highWater);
+        takeBytes(in, prevX, highWater);
+        takeBytes(in, prevY, highWater);
+        takeBytes(in, dx, highWater);
+        takeBytes(in, dy, highWater);
+        takeBytes(in, owner, highWater);
+        int words = (highWater + 63) / 64;
+        takeBytes(in, activeMask, words);
+        for (int w = words; w < oldWords; ++w) activeMask[w] = 0;
+        for (int k = oldUntouched; k < MAX_BULLETS - highWater; ++k) freeList[k] = static_cast<Uint16>(MAX_BULLETS - 1 - k);
+        takeBytes(in, freeList + MAX_BULLETS - highWater, freeCount - (MAX_BULLETS - highWater));
+    }
+
+    bool isActive(int i) const {
+        return (activeMask[i >> 6] >> (i & 63)) & 1;
+    }
+
+    SDL_Rect rectOf(int i) const {
+        return {x[i], y[i], BULLET_SIZE, BULLET_SIZE};
+    }
+
+    int spawn(int startX, int startY, int direction, BulletOwner bulletOwner) {
+        if (freeCount == 0) return -1;
+        int i = freeList[--freeCount];
+        highWater = std::max(highWater, i + 1);
+        x[i] = prevX[i] = startX;
+        y[i] = prevY[i] = startY;
+        dx[i] = (direction == 1 || direction == 3) ? (direction == 1 ? -1 : 1) : 0;
+        dy[i] = (direction == 0 || direction == 2) ? (direction == 0 ? -1 : 1) : 0;
+        owner[i] = static_cast<Uint8>(bulletOwner);
+        activeMask[i >> 6] |= Uint64(1) << (i & 63);
+        activeCount++;
+        return i;
+    }
+
+    void despawn(int i) {
+        if (!isActive(i)) return;
+        activeMask[i >> 6] &= ~(Uint64(1) << (i & 63));
+        freeList[freeCount++] = static_cast<Uint16>(i);
+        activeCount--;
+    }
+
+    template <typename Fn>
+    void forEachActive(Fn fn) {
+        for (int w = 0; w < MASK_WORDS; ++w) {
+            Uint64 bits = activeMask[w];
+            while (bits) {
+                int i = (w << 6) + lowestSetBit(bits);
+                bits &= bits - 1;
+                fn(i);
+            }
+        }
+    }
+
+    // Every bullet moves step pixels along (dx, dy). A bullet that touches a wall reports the solid sub-cells in
+    // a strip one cell wider on each side than itself and one cell deeper along its path, which is what a hit
+    // chips away.
+    void update(const CollisionGrid& grid, std::vector<WallHit>& wallHits, int step) {
+        const int cell = CollisionGrid::SUBCELL_SIZE;
+        forEachActive([&](int i) {
+            prevX[i] = x[i];
+            prevY[i] = y[i];
+            x[i] += dx[i] * step;
+            y[i] += dy[i] * step;
+            SDL_Rect rect = rectOf(i);
+            if (grid.overlapsSolid(rect)) {
+                SDL_Rect chip = rect;
+                if (dx[i] == 0) {
+                    chip.x -= cell;
+                    chip.w += 2 * cell;
+                    chip.h += cell;
+                    if (dy[i] < 0) chip.y -= cell;
+                } else {
+                    chip.y -= cell;
+                    chip.h += 2 * cell;
+                    chip.w += cell;
+                    if (dx[i] < 0) chip.x -= cell;
+                }
+                grid.forEachSolidTile(chip, [&](int row, int col, Uint16 cells) {
+                    wallHits.push_back({row, col, cells});
+                });
+                despawn(i);
+                return;
+            }
+            if (x[i] < 0 || x[i] > WORLD_WIDTH || y[i] < 0 || y[i] > WORLD_HEIGHT) {
+                despawn(i);
+            }
+        });
+    }
+
+    void render(SpriteBatch& batch, float alpha, const SDL_Rect& view) {
+        forEachActive([&](int i) {
+            SDL_Rect rect = {lerpInt(prevX[i], x[i], alpha), lerpInt(prevY[i], y[i], alpha), BULLET_SIZE, BULLET_SIZE};
+            if (intersects(view, rect.x, rect.y, BULLET_SIZE, BULLET_SIZE)) batch.draw(SPRITE_BULLET, rect);
+        });
+    }
+};
+
+const Uint8 INPUT_FIRE = 1 << 4;
+
+class PlayerTank {
+public:
+    static const int width = GRID_SIZE;
+    static const int height = GRID_SIZE;
+    static constexpr int maxHealth = 1000;
+
+    BulletOwner owner;
+    int direction;
+    bool alive;
+    float x, y;
+    int prevX, prevY;
+    float speed;  // pixels per second
+    bool keys[4];
+    bool fireRequested;
+    bool invincible;
+    Uint32 invincibleEndTime;
+    int health;
+    SDL_Rect rect;
+
+    PlayerTank() : PlayerTank(OWNER_PLAYER1, 0, 0) {
+        alive = false;
+    }
+
+    PlayerTank(BulletOwner bulletOwner, int startX, int startY) : owner(bulletOwner), alive(true),
+        invincible(false), invincibleEndTime(0), health(maxHealth) {
+        x = static_cast<float>(startX);
+        y = static_cast<float>(startY);
+        rect = {startX, startY, width, height};
+        prevX = startX;
+        prevY = startY;
+        direction = 0;
+        speed = 180.0f;
+        keys[0] = keys[1] = keys[2] = keys[3] = false;
+        fireRequested = false;
+    }
+
+    void heal(int amount = 200) {
+        if (health < maxHealth) {
+            health = std::min(maxHealth, health + amount);
+        }
+    }
+
+    void takeDamage() {
+        if (!invincible) {
+            health -= 100;
+            if (health <= 0) {
+                alive = false;
+            }
+        }
+    }
+
+    void activateInvincible(Uint32 duration, Uint32 now) {
+        if (!invincible) {
+            invincible = true;
+            invincibleEndTime = now + duration;
+        }
+    }
+
+    void updateInvincible(Uint32 now) {
+        if (invincible && now > invincibleEndTime) {
+            invincible = false;
+        }
+    }
+
+    bool checkPowerUpCollision(const SDL_Rect& powerUpRect) {
+        return SDL_HasIntersection(&rect, &powerUpRect);
+    }
+
+    Uint8 getInput() const {
+        Uint8 bits = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (keys[i]) bits |= 1 << i;
+        }
+        if (fireRequested) bits |= INPUT_FIRE;
+        return bits;
+    }
+
+    void setInput(Uint8 bits) {
+        for (int i = 0; i < 4; ++i) keys[i] = (bits >> i) & 1;
+        fireRequested = (bits & INPUT_FIRE) != 0;
+    }
+
+    void handleInput(SDL_Event& event, bool isPlayer1) {
+        if (!alive) return;
+
+        bool keyDown = (event.type == SDL_KEYDOWN);
+
+        if (isPlayer1) {
+            switch (event.key.keysym.sym) {
+                case SDLK_UP: keys[0] = keyDown; break;
+                case SDLK_LEFT: keys[1] = keyDown; break;
+                case SDLK_DOWN: keys[2] = keyDown; break;
+                case SDLK_RIGHT: keys[3] = keyDown; break;
+                case SDLK_SPACE: if (keyDown) fireRequested = true; break;
+            }
+        } else {
+            switch (event.key.keysym.sym) {
+                case SDLK_w: keys[0] = keyDown; break;
+                case SDLK_a: keys[1] = keyDown; break;
+                case SDLK_s: keys[2] = keyDown; break;
+                case SDLK_d: keys[3] = keyDown; break;
+                case SDLK_RETURN: if (keyDown) fireRequested = true; break;
+            }
+        }
+    }
+
+    bool update(const CollisionGrid& grid, BulletPool& bullets, Uint32 now, int tickRate,
+                const SDL_Rect* otherPlayerRect = nullptr) {
+        prevX = rect.x;
+        prevY = rect.y;
+        if (!alive) return false;
+
+        bool fired = false;
+        if (fireRequested) {
+            fired = shoot(bullets);
+            fireRequested = false;
+        }
+
+        float step = speed / tickRate;
+        float newX = x;
+        float newY = y;
+
+        if (keys[0]) {
+            newY -= step;
+            direction = 0;
+        }
+        if (keys[2]) {
+            newY += step;
+            direction = 2;
+        }
+        if (keys[1]) {
+            newX -= step;
+            direction = 1;
+        }
+        if (keys[3]) {
+            newX += step;
+            direction = 3;
+        }
+
+        SDL_Rect newRect = {static_cast<int>(newX), static_cast<int>(newY), width, height};
+        bool canMove = !grid.overlapsSolid(newRect);
+
+        if (otherPlayerRect && SDL_HasIntersection(&newRect, otherPlayerRect)) {
+            canMove = false;
+        }
+
+        if (canMove) {
+            x = newX;
+            y = newY;
+            rect.x = static_cast<int>(x);
+            rect.y = static_cast<int>(y);
+        }
+
+        if (rect.x < 0) rect.x = x = 0;
+        if (rect.y < 0) rect.y = y = 0;
+        if (rect.x > WORLD_WIDTH - width) rect.x = x = WORLD_WIDTH - width;
+        if (rect.y > WORLD_HEIGHT - height) rect.y = y = WORLD_HEIGHT - height;
+
+        updateInvincible(now);
+        return fired;
+    }
+
+    bool shoot(BulletPool& bullets) {
+        return bullets.spawn(rect.x + width / 2 - BULLET_SIZE / 2, rect.y + height / 2 - BULLET_SIZE / 2,
+                             direction, owner) >= 0;
+    }
+};
+
+// Runs a job split into numbered tasks on a fixed set of threads. Each thread starts on its own contiguous
+// run of tasks and, once that is drained, steals from the runs of the others.
+class WorkerPool {
+public:
+    struct alignas(64) TaskRange {
+        std::atomic<int> next;
+        int end;
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<TaskRange[]> ranges;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* job;
+    Uint64 generation;
+    int busyWorkers;
+    bool stopping;
+
+    WorkerPool() : job(nullptr), generation(0), busyWorkers(0), stopping(false) {}
+
+    ~WorkerPool() {
+        stop();
+    }
+
+    int threadCount() const {
+        return static_cast<int>(threads.size()) + 1;
+    }
+
+    void start(int count) {
+        stop();
+        stopping = false;
+        ranges.reset(new TaskRange[std::max(count, 1)]);
+        for (int id = 1; id < count; ++id) {
+            threads.emplace_back([this, id] { workerLoop(id); });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+        threads.clear();
+    }
+
+    void run(int taskCount, const std::function<void(int)>& fn) {
+        if (threads.empty() || taskCount <= 1) {
+            for (int t = 0; t < taskCount; ++t) fn(t);
+            return;
+        }
+
+        int n = threadCount();
+        for (int w = 0; w < n; ++w) {
+            ranges[w].next.store(taskCount * w / n, std::memory_order_relaxed);
+            ranges[w].end = taskCount * (w + 1) / n;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            busyWorkers = static_cast<int>(threads.size());
+            generation++;
+        }
+        wake.notify_all();
+
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busyWorkers == 0; });
+        job = nullptr;
+    }
+
+    void drain(int id) {
+        int n = threadCount();
+        for (int k = 0; k < n; ++k) {
+            TaskRange& range = ranges[(id + k) % n];
+            for (;;) {
+                int task = range.next.fetch_add(1, std::memory_order_relaxed);
+                if (task >= range.end) break;
+                (*job)(task);
+            }
+        }
+    }
+
+    void workerLoop(int id) {
+        Uint64 seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            drain(id);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busyWorkers == 0) done.notify_one();
+            }
+        }
+    }
+};
+
+const int MAX_PLAYERS = 2;
+const int MAX_ENEMIES = 1024;
+
+struct EnemyShot {
+    int x;
+    int y;
+    Uint8 direction;
+};
+
+// Side effects recorded by one chunk of enemies during the (possibly parallel) update, applied afterwards in
+// chunk order so the outcome does not depend on which thread ran which chunk.
+struct EnemyCommandBuffer {
+    std::vector<EnemyShot> shots;
+};
+
+class EnemyPool {
+public:
+    static const int CHUNK_SIZE = 64;
+
+    int count;
+    int x[MAX_ENEMIES];
+    int y[MAX_ENEMIES];
+    int prevX[MAX_ENEMIES];
+    int prevY[MAX_ENEMIES];
+    Uint8 direction[MAX_ENEMIES];
+    Uint8 target[MAX_ENEMIES];
+    Uint8 alive[MAX_ENEMIES];
+    Uint8 frozen[MAX_ENEMIES];
+    int moveTimer[MAX_ENEMIES];
+    int shootCooldown[MAX_ENEMIES];
+    Uint32 freezeEndTime[MAX_ENEMIES];
+    Uint16 slot[MAX_ENEMIES];  // stable for the enemy's lifetime; doubles as its network id
+    Random rngs[MAX_ENEMIES];
+
+    Uint16 freeSlots[MAX_ENEMIES];
+    int freeSlotCount;
+    int slotHighWater;  // slots handed out since clear(), as BulletPool::highWater
+
+    int tickRate;
+    int moveDuration;        // ticks
+    int moveSpeed;           // pixels per second
+    int shootCooldownTicks;
+    int shootRoll;           // a shot is tried when rngs[i].nextInt(shootRoll) < 10
+    int shootRange;
+    int turnChance;
+    int parallelThreshold;
+
+    EnemyPool() : tickRate(DEFAULT_TICK_RATE), moveDuration(50), moveSpeed(120), shootCooldownTicks(60),
+                  shootRoll(100), shootRange(200), turnChance(20), parallelThreshold(256) {
+        clear();
+    }
+
+    // Timers come in milliseconds and are kept as tick counts for the given rate.
+    void setTiming(int ticksPerSecond, int moveDurationMs, int shootCooldownMs) {
+        tickRate = ticksPerSecond;
+        moveDuration = ticksFor(moveDurationMs, tickRate);
+        shootCooldownTicks = ticksFor(shootCooldownMs, tickRate);
+        // Six tries a second on average, which is 10 in 100 per tick at 60 Hz.
+        shootRoll = std::max(10, tickRate * 10 / 6);
+    }
+
+    void clear() {
+        count = 0;
+        for (int i = 0; i < MAX_ENEMIES; ++i) {
+            freeSlots[i] = static_cast<Uint16>(MAX_ENEMIES - 1 - i);
+        }
+        freeSlotCount = MAX_ENEMIES;
+        slotHighWater = 0;
+    }
+
+    void saveTo(std::vector<Uint8>& out) const {
+        int header[3] = {count, freeSlotCount, slotHighWater};
+        appendBytes(out, header, 3);
+        appendBytes(out, x, count);
+        appendBytes(out, y, count);
+        appendBytes(out, prevX, count);
+        appendBytes(out, prevY, count);
+        appendBytes(out, direction, count);
+        appendBytes(out, target, count);
+        appendBytes(out, alive, count);
+        appendBytes(out, frozen, count);
+        appendBytes(out, moveTimer, count);
+        appendBytes(out, shootCooldown, count);
+        appendBytes(out, freezeEndTime, count);
+        appendBytes(out, slot, count);
+        appendBytes(out, rngs, count);
+        appendBytes(out, freeSlots + MAX_ENEMIES - slotHighWater, freeSlotCount - (MAX_ENEMIES - slotHighWater));
+    }
+
+    void restoreFrom(const Uint8*& in) {
+        int header[3];
+        takeBytes(in, header, 3);
+        int oldUntouched = MAX_ENEMIES - slotHighWater;
+        count = header[0];
+        freeSlotCount = header[1];
+        slotHighWater = header[2];
+        takeBytes(in, x, count);
+        takeBytes(in, y, count);
+        takeBytes(in, prevX, count);
+        takeBytes(in, prevY, count);
+        takeBytes(in, direction, count);
+        takeBytes(in, target, count);
+        takeBytes(in, alive, count);
+        takeBytes(in, frozen, count);
+        takeBytes(in, moveTimer, count);
+        takeBytes(in, shootCooldown, count);
+        takeBytes(in, freezeEndTime, count);
+        takeBytes(in, slot, count);
+        takeBytes(in, rngs, count);
+        for (int k = oldUntouched; k < MAX_ENEMIES - slotHighWater; ++k) freeSlots[k] = static_cast<Uint16>(MAX_ENEMIES - 1 - k);
+        takeBytes(in, freeSlots + MAX_ENEMIES - slotHighWater, freeSlotCount - (MAX_ENEMIES - slotHighWater));
+    }
+
+    SDL_Rect rectOf(int i) const {
+        return {x[i], y[i], GRID_SIZE, GRID_SIZE};
+    }
+
+    int spawn(int startX, int startY, int targetPlayer, Random& rng) {
+        if (count == MAX_ENEMIES) return -1;
+        int i = count++;
+        slot[i] = freeSlots[--freeSlotCount];
+        slotHighWater = std::max(slotHighWater, slot[i] + 1);
+        x[i] = prevX[i] = startX;
+        y[i] = prevY[i] = startY;
+        rngs[i].seed(rng.next());
+        direction[i] = static_cast<Uint8>(rngs[i].nextInt(4));
+        target[i] = static_cast<Uint8>(targetPlayer);
+        alive[i] = 1;
+        frozen[i] = 0;
+        moveTimer[i] = 0;
+        shootCooldown[i] = 0;
+        freezeEndTime[i] = 0;
+        return i;
+    }
+
+    void removeAt(int i) {
+        freeSlots[freeSlotCount++] = slot[i];
+
+        int last = --count;
+        if (i != last) {
+            x[i] = x[last];
+            y[i] = y[last];
+            prevX[i] = prevX[last];
+            prevY[i] = prevY[last];
+            direction[i] = direction[last];
+            target[i] = target[last];
+            alive[i] = alive[last];
+            frozen[i] = frozen[last];
+            moveTimer[i] = moveTimer[last];
+            shootCooldown[i] = shootCooldown[last];
+            freezeEndTime[i] = freezeEndTime[last];
+            slot[i] = slot[last];
+            rngs[i] = rngs[last];
+        }
+    }
+
+    int removeDead() {
+        int removed = 0;
+        for (int i = count - 1; i >= 0; --i) {
+            if (!alive[i]) {
+                removeAt(i);
+                removed++;
+            }
+        }
+        return removed;
+    }
+
+    void freezeAll(Uint32 duration, Uint32 now) {
+        for (int i = 0; i < count; ++i) {
+            frozen[i] = 1;
+            freezeEndTime[i] = now + duration;
+        }
+    }
+
+    bool isTileAligned(int i) const {
+        return x[i] % GRID_SIZE == 0 && y[i] % GRID_SIZE == 0;
+    }
+
+    void chooseDirectionTowardsPlayer(int i, const PlayerTank& player, const FlowField& field) {
+        int flowDirection = -1;
+        if (isTileAligned(i)) {
+            flowDirection = field.directionFrom(y[i] / GRID_SIZE, x[i] / GRID_SIZE, direction[i]);
+        }
+
+        if (flowDirection >= 0) {
+            direction[i] = static_cast<Uint8>(flowDirection);
+        } else {
+            int deltaX = x[i] - player.rect.x;
+            int deltaY = y[i] - player.rect.y;
+            if (abs(deltaX) > abs(deltaY)) {
+                direction[i] = deltaX > 0 ? 1 : 3;
+            } else {
+                direction[i] = deltaY > 0 ? 0 : 2;
+            }
+        }
+
+        if (rngs[i].nextInt(100) < turnChance) direction[i] = static_cast<Uint8>(rngs[i].nextInt(4));
+    }
+
+    // Moves position by delta but no further than the next tile boundary, so enemies still stop on every tile
+    // when a tick's step does not divide GRID_SIZE.
+    static int stepWithinTile(int position, int delta) {
+        if (delta > 0) return std::min(position + delta, (position / GRID_SIZE + 1) * GRID_SIZE);
+        if (delta < 0) return std::max(position + delta, ((position + GRID_SIZE - 1) / GRID_SIZE - 1) * GRID_SIZE);
+        return position;
+    }
+
+    bool move(int i, const CollisionGrid& grid, int step) {
+        int dir = direction[i];
+        int newX = stepWithinTile(x[i], dir == 1 ? -step : dir == 3 ? step : 0);
+        int newY = stepWithinTile(y[i], dir == 0 ? -step : dir == 2 ? step : 0);
+        SDL_Rect newRect = {newX, newY, GRID_SIZE, GRID_SIZE};
+
+        if (newX >= 0 && newX + GRID_SIZE <= WORLD_WIDTH && newY >= 0 && newY + GRID_SIZE <= WORLD_HEIGHT &&
+            !grid.overlapsSolid(newRect)) {
+            x[i] = newX;
+            y[i] = newY;
+            return true;
+        }
+        return false;
+    }
+
+    void updateOne(int i, const CollisionGrid& grid, const PlayerTank* players, const FlowField* fields, int step,
+                   EnemyCommandBuffer& commands) {
+        prevX[i] = x[i];
+        prevY[i] = y[i];
+        if (!alive[i] || frozen[i]) return;
+
+        Random& rng = rngs[i];
+        const PlayerTank& player = players[target[i]];
+        moveTimer[i]++;
+        if (!player.alive) {
+            if (moveTimer[i] >= moveDuration) {
+                direction[i] = static_cast<Uint8>(rng.nextInt(4));
+                moveTimer[i] = 0;
+            }
+            if (!move(i, grid, step)) direction[i] = static_cast<Uint8>(rng.nextInt(4));
+            return;
+        }
+
+        // Re-path every moveDuration ticks as before; flow fields are only read on tile boundaries, so a turn
+        // that falls between tiles waits for the next one.
+        const FlowField& field = fields[target[i]];
+        if (moveTimer[i] >= moveDuration && isTileAligned(i)) {
+            chooseDirectionTowardsPlayer(i, player, field);
+            moveTimer[i] = 0;
+        }
+        // Blocked: re-choose like the original EnemyTank, from the flow field on a tile and greedily between tiles.
+        if (!move(i, grid, step)) chooseDirectionTowardsPlayer(i, player, field);
+
+        if (shootCooldown[i] > 0) shootCooldown[i]--;
+
+        int distance = abs(x[i] - player.rect.x) + abs(y[i] - player.rect.y);
+        if (distance < shootRange && rng.nextInt(shootRoll) < 10 && shootCooldown[i] == 0) {
+            shootCooldown[i] = shootCooldownTicks;
+            commands.shots.push_back({x[i] + GRID_SIZE / 2 - BULLET_SIZE / 2, y[i] + GRID_SIZE / 2 - BULLET_SIZE / 2,
+                                      direction[i]});
+        }
+    }
+
+    // Enemies only read shared state and write their own slots, so chunks can run on any thread; bullets are
+    // spawned afterwards in chunk order. commandBuffers is scratch owned by the caller, which keeps the pool
+    // plain data. Returns the number of shots fired.
+    int update(const CollisionGrid& grid, const PlayerTank* players, const FlowField* fields, BulletPool& bullets,
+               std::vector<EnemyCommandBuffer>& commandBuffers, Uint32 tick, Uint32 now, WorkerPool* workers) {
+        int step = stepDistance(moveSpeed, tick, tickRate);
+        int chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        if (static_cast<int>(commandBuffers.size()) < chunks) commandBuffers.resize(chunks);
+
+        std::function<void(int)> runChunk = [&](int chunk) {
+            EnemyCommandBuffer& commands = commandBuffers[chunk];
+            commands.shots.clear();
+            int end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+            for (int i = chunk * CHUNK_SIZE; i < end; ++i) {
+                updateOne(i, grid, players, fields, step, commands);
+                if (frozen[i] && now > freezeEndTime[i]) frozen[i] = 0;
+            }
+        };
+        if (workers && count >= parallelThreshold) {
+            workers->run(chunks, runChunk);
+        } else {
+            for (int chunk = 0; chunk < chunks; ++chunk) runChunk(chunk);
+        }
+
+        int shots = 0;
+        for (int chunk = 0; chunk < chunks; ++chunk) {
+            for (const EnemyShot& shot : commandBuffers[chunk].shots) {
+                if (bullets.spawn(shot.x, shot.y, shot.direction, OWNER_ENEMY) >= 0) shots++;
+            }
+        }
+        return shots;
+    }
+};
+
+// Tile coordinates of a spawn point in a level file.
+struct LevelSpawn {
+    Uint16 col;
+    Uint16 row;
+};
+
+// Header of a .bclv level file. Fields are little-endian and sections are 4-byte aligned, so a mapped file is
+// used in place: tiles is MAP_ROWS x MAP_COLS bytes laid out like Game::map, and the collision section holds
+// the CollisionGrid::mask words.
+struct LevelHeader {
+    char magic[4];
+    Uint32 version;
+    Uint16 rows;
+    Uint16 cols;
+    LevelSpawn playerSpawns[MAX_PLAYERS];
+    Uint32 enemySpawnCount;
+    Uint32 tilesOffset;
+    Uint32 collisionOffset;
+    Uint32 enemySpawnsOffset;
+};
+
+class Level {
+public:
+    static const Uint32 VERSION = 2;
+
+    MappedFile file;
+    const LevelHeader* header;
+    const Uint8* tiles;
+    const Uint8* collisionData;
+    const LevelSpawn* enemySpawns;
+
+    Level() : header(nullptr), tiles(nullptr), collisionData(nullptr), enemySpawns(nullptr) {}
+
+    static bool sectionFits(size_t fileSize, Uint32 offset, size_t length, size_t alignment) {
+        return offset % alignment == 0 && offset <= fileSize && length <= fileSize - offset;
+    }
+
+    bool load(const std::string& path) {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        std::cerr << "Level files are little-endian only: " << path << std::endl;
+        return false;
+#else
+        if (!file.open(path)) {
+            std::cerr << "Failed to map level: " << path << std::endl;
+            return false;
+        }
+        const LevelHeader* h = reinterpret_cast<const LevelHeader*>(file.data);
+        const size_t gridBytes = MAP_ROWS * MAP_COLS;
+        if (file.size < sizeof(LevelHeader) || memcmp(h->magic, "BCLV", 4) != 0 ||
+            h->version != VERSION || h->rows != MAP_ROWS || h->cols != MAP_COLS ||
+            !sectionFits(file.size, h->tilesOffset, gridBytes, 1) ||
+            !sectionFits(file.size, h->collisionOffset, gridBytes * sizeof(Uint16), alignof(Uint16)) ||
+            !sectionFits(file.size, h->enemySpawnsOffset, h->enemySpawnCount * sizeof(LevelSpawn),
+                         alignof(LevelSpawn))) {
+            std::cerr << "Invalid level file: " << path << std::endl;
+            file.close();
+            return false;
+        }
+        const Uint8* tileData = file.data + h->tilesOffset;
+        const Uint8* collision = file.data + h->collisionOffset;
+        const LevelSpawn* spawnData = reinterpret_cast<const LevelSpawn*>(file.data + h->enemySpawnsOffset);
+        if (!tilesValid(tileData) || !spawnsValid(tileData, h->playerSpawns, MAX_PLAYERS) ||
+            !spawnsValid(tileData, spawnData, h->enemySpawnCount)) {
+            std::cerr << "Invalid level contents: " << path << std::endl;
+            file.close();
+            return false;
+        }
+        header = h;
+        tiles = tileData;
+        collisionData = collision;
+        enemySpawns = spawnData;
+        return true;
+#endif
+    }
+
+    // Tiles are 0 (empty), 1 (stone) or 2 (brick).
+    static bool tilesValid(const Uint8* data) {
+        for (int i = 0; i < MAP_ROWS * MAP_COLS; ++i) {
+            if (data[i] > 2) return false;
+        }
+        return true;
+    }
+
+    // A spawn's GRID_SIZE rect covers exactly its tile, which has to be on the map and empty.
+    static bool spawnsValid(const Uint8* tileData, const LevelSpawn* spawns, Uint32 count) {
+        for (Uint32 i = 0; i < count; ++i) {
+            if (spawns[i].col >= MAP_COLS || spawns[i].row >= MAP_ROWS) return false;
+            if (tileData[spawns[i].row * MAP_COLS + spawns[i].col] != 0) return false;
+        }
+        return true;
+    }
+
+    void copyMasks(Uint16 masks[MAP_ROWS][MAP_COLS]) const {
+        memcpy(masks, collisionData, MAP_ROWS * MAP_COLS * sizeof(Uint16));
+    }
+
+    static Uint32 align4(size_t offset) {
+        return static_cast<Uint32>((offset + 3) & ~size_t(3));
+    }
+
+    static bool write(const std::string& path, const Uint8 tiles[MAP_ROWS][MAP_COLS],
+                      const LevelSpawn playerSpawns[MAX_PLAYERS], const std::vector<LevelSpawn>& enemySpawns) {
+        CollisionGrid grid;
+        grid.build(tiles);
+
+        LevelHeader header;
+        std::memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "BCLV", 4);
+        header.version = VERSION;
+        header.rows = MAP_ROWS;
+        header.cols = MAP_COLS;
+        for (int p = 0; p < MAX_PLAYERS; ++p) header.playerSpawns[p] = playerSpawns[p];
+        header.enemySpawnCount = static_cast<Uint32>(enemySpawns.size());
+        header.tilesOffset = align4(sizeof(LevelHeader));
+        header.collisionOffset = align4(header.tilesOffset + MAP_ROWS * MAP_COLS);
+        header.enemySpawnsOffset = align4(header.collisionOffset + sizeof(grid.mask));
+
+        std::ofstream out(path, std::ios::binary);
+        auto padTo = [&out](Uint32 offset) {
+            while (out && static_cast<Uint32>(out.tellp()) < offset) out.put(0);
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        padTo(header.tilesOffset);
+        out.write(reinterpret_cast<const char*>(tiles), MAP_ROWS * MAP_COLS);
+        padTo(header.collisionOffset);
+        out.write(reinterpret_cast<const char*>(grid.mask), sizeof(grid.mask));
+        padTo(header.enemySpawnsOffset);
+        out.write(reinterpret_cast<const char*>(enemySpawns.data()), enemySpawns.size() * sizeof(LevelSpawn));
+        if (!out) {
+            std::cerr << "Failed to write level: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Difficulty knobs. The defaults are the shipped game; matchrunner sweeps them.
+struct GameTuning {
+    int enemyMoveDuration;        // ms an enemy keeps its heading
+    int enemyShootCooldown;       // ms between shots of one enemy
+    Uint32 powerUpSpawnInterval;  // ms of game time between power-ups
+    int baseEnemies;              // a wave has baseEnemies + wave / wavesPerExtraEnemy enemies
+    int wavesPerExtraEnemy;
+
+    GameTuning() : enemyMoveDuration(833), enemyShootCooldown(1000), powerUpSpawnInterval(20000), baseEnemies(1),
+                   wavesPerExtraEnemy(2) {}
+};
+
+// Everything a game's outcome depends on besides the inputs is in the header: playback applies the settings
+// and refuses to run against a different set of level files.
+class InputReplay {
+public:
+    static const Uint32 VERSION = 4;
+    // A day at the highest tick rate. Runs expand to two bytes a tick, so a corrupt header cannot ask for more.
+    static const Uint32 MAX_TICKS = Uint32(MAX_TICK_RATE) * 60 * 60 * 24;
+
+    Uint32 seed;
+    Uint32 tickRate;
+    Uint8 mode;
+    Uint32 maxEnemiesPerWave;
+    GameTuning tuning;
+    Uint32 levelCount;
+    Uint32 levelHash;
+    Uint32 finalHash;
+    std::vector<Uint8> inputs;
+
+    InputReplay() : seed(0), tickRate(DEFAULT_TICK_RATE), mode(STATE_1P), maxEnemiesPerWave(0), levelCount(0),
+                    levelHash(0), finalHash(0) {}
+
+    void begin(Uint32 seedValue, int ticksPerSecond, GameState gameMode, int maxEnemies, const GameTuning& values,
+               Uint32 levels, Uint32 levelsHash) {
+        seed = seedValue;
+        tickRate = static_cast<Uint32>(ticksPerSecond);
+        mode = static_cast<Uint8>(gameMode);
+        maxEnemiesPerWave = static_cast<Uint32>(maxEnemies);
+        tuning = values;
+        levelCount = levels;
+        levelHash = levelsHash;
+        finalHash = 0;
+        inputs.clear();
+    }
+
+    Uint32 tickCount() const {
+        return static_cast<Uint32>(inputs.size() / 2);
+    }
+
+    void record(Uint8 player1Input, Uint8 player2Input) {
+        inputs.push_back(player1Input);
+        inputs.push_back(player2Input);
+    }
+
+    bool inputAt(Uint32 tick, Uint8& player1Input, Uint8& player2Input) const {
+        if (tick >= tickCount()) return false;
+        player1Input = inputs[tick * 2];
+        player2Input = inputs[tick * 2 + 1];
+        return true;
+    }
+
+    static void writeU32(std::ostream& out, Uint32 value) {
+        Uint8 bytes[4] = {Uint8(value), Uint8(value >> 8), Uint8(value >> 16), Uint8(value >> 24)};
+        out.write(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    static bool readU32(std::istream& in, Uint32& value) {
+        Uint8 bytes[4];
+        if (!in.read(reinterpret_cast<char*>(bytes), 4)) return false;
+        value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (Uint32(bytes[3]) << 24);
+        return true;
+    }
+
+    // Inputs change rarely, so ticks are stored as (run length, player 1 input, player 2 input) runs.
+    bool save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "Failed to open replay for writing: " << path << std::endl;
+            return false;
+        }
+        out.write("BCRP", 4);
+        writeU32(out, VERSION);
+        writeU32(out, seed);
+        writeU32(out, tickRate);
+        writeU32(out, mode);
+        writeU32(out, maxEnemiesPerWave);
+        writeU32(out, static_cast<Uint32>(tuning.enemyMoveDuration));
+        writeU32(out, static_cast<Uint32>(tuning.enemyShootCooldown));
+        writeU32(out, tuning.powerUpSpawnInterval);
+        writeU32(out, static_cast<Uint32>(tuning.baseEnemies));
+        writeU32(out, static_cast<Uint32>(tuning.wavesPerExtraEnemy));
+        writeU32(out, levelCount);
+        writeU32(out, levelHash);
+        writeU32(out, tickCount());
+        writeU32(out, finalHash);
+
+        Uint32 tick = 0;
+        while (tick < tickCount()) {
+            Uint32 run = 1;
+            while (tick + run < tickCount() && run < 0xFFFFFFFFu &&
+                   inputs[(tick + run) * 2] == inputs[tick * 2] &&
+                   inputs[(tick + run) * 2 + 1] == inputs[tick * 2 + 1]) {
+                run++;
+            }
+            writeU32(out, run);
+            out.put(static_cast<char>(inputs[tick * 2]));
+            out.put(static_cast<char>(inputs[tick * 2 + 1]));
+            tick += run;
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Failed to open replay: " << path << std::endl;
+            return false;
+        }
+        char magic[4];
+        Uint32 version, modeValue, ticks;
+        Uint32 tuningValues[5];
+        if (!in.read(magic, 4) || memcmp(magic, "BCRP", 4) != 0 || !readU32(in, version) || version != VERSION) {
+            std::cerr << "Not a replay file: " << path << std::endl;
+            return false;
+        }
+        bool complete = readU32(in, seed) && readU32(in, tickRate) && readU32(in, modeValue) &&
+                        readU32(in, maxEnemiesPerWave);
+        for (Uint32& value : tuningValues) complete = complete && readU32(in, value);
+        if (!complete || !readU32(in, levelCount) || !readU32(in, levelHash) || !readU32(in, ticks) ||
+            !readU32(in, finalHash)) {
+            std::cerr << "Truncated replay header: " << path << std::endl;
+            return false;
+        }
+        mode = static_cast<Uint8>(modeValue);
+        tuning.enemyMoveDuration = static_cast<int>(tuningValues[0]);
+        tuning.enemyShootCooldown = static_cast<int>(tuningValues[1]);
+        tuning.powerUpSpawnInterval = tuningValues[2];
+        tuning.baseEnemies = static_cast<int>(tuningValues[3]);
+        tuning.wavesPerExtraEnemy = static_cast<int>(tuningValues[4]);
+        if (ticks > MAX_TICKS) {
+            std::cerr << "Replay too long (" << ticks << " ticks): " << path << std::endl;
+            return false;
+        }
+        // No reserve from the header: the tick count is only trusted once the runs behind it have been read.
+        inputs.clear();
+        while (tickCount() < ticks) {
+            Uint32 run;
+            char input1, input2;
+            if (!readU32(in, run) || !in.get(input1) || !in.get(input2) || run > ticks - tickCount()) {
+                std::cerr << "Truncated replay data: " << path << std::endl;
+                return false;
+            }
+            for (Uint32 i = 0; i < run; ++i) record(static_cast<Uint8>(input1), static_cast<Uint8>(input2));
+        }
+        return true;
+    }
+};
+
+enum ProfilePhase {
+    PHASE_FRAME,
+    PHASE_EVENTS,
+    PHASE_UPDATE,
+    PHASE_PLAYERS,
+    PHASE_ENEMIES,
+    PHASE_COLLISION,
+    PHASE_POWERUPS,
+    PHASE_RENDER,
+    PHASE_TERRAIN,
+    PHASE_ENTITIES,
+    PHASE_HUD,
+    PHASE_PRESENT,
+    PHASE_COUNT
+};
+
+static const char* const PHASE_NAMES[PHASE_COUNT] = {
+    "frame", "events", "update", "players", "enemies", "collision", "powerups",
+    "render", "terrain", "entities", "hud", "present"
+};
+
+struct FrameSample {
+    Uint64 frame;
+    Uint64 counts[PHASE_COUNT];
+};
+
+// Single-producer/single-consumer queue: the game thread pushes finished frames, the CSV writer pops them.
+class ProfileRing {
+public:
+    static const Uint32 CAPACITY = 1024;
+
+    FrameSample samples[CAPACITY];
+    std::atomic<Uint32> head;
+    std::atomic<Uint32> tail;
+
+    ProfileRing() : head(0), tail(0) {}
+
+    bool push(const FrameSample& sample) {
+        Uint32 t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == CAPACITY) return false;
+        samples[t % CAPACITY] = sample;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(FrameSample& sample) {
+        Uint32 h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        sample = samples[h % CAPACITY];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+class Profiler {
+public:
+    static constexpr int HISTORY_SIZE = 240;
+
+    Uint64 frequency;
+    bool overlayVisible;
+    FrameSample current;
+    Uint64 frameStart;
+    Uint64 history[PHASE_COUNT][HISTORY_SIZE];
+    int historyCount;
+    int historyPos;
+    ProfileRing ring;
+    Uint64 droppedSamples;
+    bool waitWhenFull;
+    std::thread csvWriter;
+    std::atomic<bool> csvRunning;
+
+    Profiler() : frequency(SDL_GetPerformanceFrequency()), overlayVisible(false), frameStart(0), historyCount(0),
+                 historyPos(0), droppedSamples(0), waitWhenFull(false), csvRunning(false) {
+        std::memset(&current, 0, sizeof(current));
+        std::memset(history, 0, sizeof(history));
+    }
+
+    ~Profiler() {
+        closeCsv();
+    }
+
+    bool active() const {
+        return overlayVisible || csvRunning.load(std::memory_order_relaxed);
+    }
+
+    bool openCsv(const std::string& path) {
+        closeCsv();
+        std::ofstream* out = new std::ofstream(path);
+        if (!*out) {
+            std::cerr << "Failed to open profile CSV: " << path << std::endl;
+            delete out;
+            return false;
+        }
+        *out << "frame";
+        for (int p = 0; p < PHASE_COUNT; ++p) *out << ',' << PHASE_NAMES[p] << "_ms";
+        *out << '\n';
+        csvRunning = true;
+        csvWriter = std::thread([this, out] {
+            FrameSample sample;
+            for (;;) {
+                bool running = csvRunning.load(std::memory_order_acquire);
+                bool wrote = false;
+                while (ring.pop(sample)) {
+                    *out << sample.frame;
+                    for (int p = 0; p < PHASE_COUNT; ++p) *out << ',' << toMilliseconds(sample.counts[p]);
+                    *out << '\n';
+                    wrote = true;
+                }
+                if (!running) break;
+                if (!wrote) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            delete out;
+        });
+        return true;
+    }
+
+    void closeCsv() {
+        if (!csvWriter.joinable()) return;
+        csvRunning = false;
+        csvWriter.join();
+        if (droppedSamples > 0) std::cerr << "Profiler dropped " << droppedSamples << " samples" << std::endl;
+    }
+
+    double toMilliseconds(Uint64 counts) const {
+        return counts * 1000.0 / frequency;
+    }
+
+    void beginFrame() {
+        if (!active()) return;
+        frameStart = SDL_GetPerformanceCounter();
+    }
+
+    void add(ProfilePhase phase, Uint64 counts) {
+        current.counts[phase] += counts;
+    }
+
+    void endFrame() {
+        if (!active()) return;
+        current.counts[PHASE_FRAME] = SDL_GetPerformanceCounter() - frameStart;
+        for (int p = 0; p < PHASE_COUNT; ++p) history[p][historyPos] = current.counts[p];
+        historyPos = (historyPos + 1) % HISTORY_SIZE;
+        historyCount = std::min(historyCount + 1, HISTORY_SIZE);
+        if (csvRunning.load(std::memory_order_relaxed)) {
+            while (!ring.push(current)) {
+                if (!waitWhenFull) {
+                    droppedSamples++;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        Uint64 frame = current.frame + 1;
+        std::memset(&current, 0, sizeof(current));
+        current.frame = frame;
+    }
+
+    // Drops what has been timed since beginFrame() for a pass that draws nothing, so it is not added to the
+    // next frame that does.
+    void discardFrame() {
+        Uint64 frame = current.frame;
+        std::memset(&current, 0, sizeof(current));
+        current.frame = frame;
+    }
+
+    // Percentile (0-100) of a phase over the rolling history, in milliseconds.
+    double percentile(ProfilePhase phase, int pct) const {
+        if (historyCount == 0) return 0;
+        Uint64 values[HISTORY_SIZE];
+        std::copy(history[phase], history[phase] + historyCount, values);
+        int k = std::min(historyCount - 1, historyCount * pct / 100);
+        std::nth_element(values, values + k, values + historyCount);
+        return toMilliseconds(values[k]);
+    }
+};
+
+class ProfileScope {
+public:
+    Profiler& profiler;
+    ProfilePhase phase;
+    Uint64 start;
+
+    ProfileScope(Profiler& owner, ProfilePhase timedPhase) : profiler(owner), phase(timedPhase),
+                                                            start(owner.active() ? SDL_GetPerformanceCounter() : 0) {}
+
+    ~ProfileScope() {
+        if (start) profiler.add(phase, SDL_GetPerformanceCounter() - start);
+    }
+};
+
+inline bool netStartup() {
+#ifdef _WIN32
+    static bool started = false;
+    if (!started) {
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) return false;
+        started = true;
+    }
+#endif
+    return true;
+}
+
+// IPv4 address and port, both kept in network byte order.
+struct NetAddress {
+    Uint32 host;
+    Uint16 port;
+
+    NetAddress() : host(0), port(0) {}
+
+    bool operator==(const NetAddress& other) const {
+        return host == other.host && port == other.port;
+    }
+
+    // Accepts "host:port" where host is a name or a dotted quad.
+    static bool resolve(const std::string& text, NetAddress& address) {
+        size_t colon = text.rfind(':');
+        if (colon == std::string::npos || colon == 0 || !netStartup()) return false;
+        int port = atoi(text.c_str() + colon + 1);
+        if (port <= 0 || port > 65535) return false;
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(text.substr(0, colon).c_str(), nullptr, &hints, &result) != 0 || !result) return false;
+        address.host = reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr.s_addr;
+        address.port = htons(static_cast<Uint16>(port));
+        freeaddrinfo(result);
+        return true;
+    }
+
+    std::string toString() const {
+        const Uint8* bytes = reinterpret_cast<const Uint8*>(&host);
+        char text[32];
+        snprintf(text, sizeof(text), "%d.%d.%d.%d:%d", bytes[0], bytes[1], bytes[2], bytes[3], ntohs(port));
+        return text;
+    }
+};
+
+// Non-blocking UDP socket over BSD sockets, or Winsock on Windows.
+class UdpSocket {
+public:
+#ifdef _WIN32
+    typedef SOCKET Handle;
+#else
+    typedef int Handle;
+#endif
+
+    Handle handle;
+
+    UdpSocket() : handle(invalidHandle()) {}
+
+    ~UdpSocket() {
+        close();
+    }
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    static Handle invalidHandle() {
+#ifdef _WIN32
+        return INVALID_SOCKET;
+#else
+        return -1;
+#endif
+    }
+
+    bool isOpen() const {
+        return handle != invalidHandle();
+    }
+
+    // Port 0 lets the system pick one, which is what clients want.
+    bool open(Uint16 port) {
+        close();
+        if (!netStartup()) return false;
+        handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (!isOpen()) return false;
+
+        int bufferSize = 1 << 20;
+        setsockopt(handle, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+
+        sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(port);
+        bool ok = bind(handle, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0;
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ok = ok && ioctlsocket(handle, FIONBIO, &nonBlocking) == 0;
+#else
+        ok = ok && fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+        if (!ok) close();
+        return ok;
+    }
+
+    void close() {
+        if (!isOpen()) return;
+#ifdef _WIN32
+        closesocket(handle);
+#else
+        ::close(handle);
+#endif
+        handle = invalidHandle();
+    }
+
+    bool send(const NetAddress& to, const std::vector<Uint8>& data) {
+        sockaddr_in remote;
+        memset(&remote, 0, sizeof(remote));
+        remote.sin_family = AF_INET;
+        remote.sin_addr.s_addr = to.host;
+        remote.sin_port = to.port;
+        int sent = static_cast<int>(sendto(handle, reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size()),
+                                           0, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)));
+        return sent == static_cast<int>(data.size());
+    }
+
+    // Returns the datagram size, or -1 once nothing is waiting.
+    int receive(Uint8* buffer, int capacity, NetAddress& from) {
+        sockaddr_in remote;
+        socklen_t length = sizeof(remote);
+        int received = static_cast<int>(recvfrom(handle, reinterpret_cast<char*>(buffer), capacity, 0,
+                                                 reinterpret_cast<sockaddr*>(&remote), &length));
+        if (received < 0) return -1;
+        from.host = remote.sin_addr.s_addr;
+        from.port = remote.sin_port;
+        return received;
+    }
+};
+
+class NetWriter {
+public:
+    std::vector<Uint8>& bytes;
+
+    explicit NetWriter(std::vector<Uint8>& out) : bytes(out) {}
+
+    void u8(Uint8 value) {
+        bytes.push_back(value);
+    }
+
+    void u16(Uint16 value) {
+        u8(static_cast<Uint8>(value));
+        u8(static_cast<Uint8>(value >> 8));
+    }
+
+    void u24(Uint32 value) {
+        u16(static_cast<Uint16>(value));
+        u8(static_cast<Uint8>(value >> 16));
+    }
+
+    void u32(Uint32 value) {
+        u16(static_cast<Uint16>(value));
+        u16(static_cast<Uint16>(value >> 16));
+    }
+
+    void varint(Uint32 value) {
+        while (value >= 0x80) {
+            u8(static_cast<Uint8>(value | 0x80));
+            value >>= 7;
+        }
+        u8(static_cast<Uint8>(value));
+    }
+};
+
+// Reads past the end yield zeros and clear ok, so a message is parsed in full and checked once.
+class NetReader {
+public:
+    const Uint8* data;
+    size_t size;
+    size_t pos;
+    bool ok;
+
+    NetReader(const Uint8* bytes, size_t length) : data(bytes), size(length), pos(0), ok(true) {}
+
+    bool atEnd() const {
+        return pos == size;
+    }
+
+    Uint8 u8() {
+        if (pos >= size) {
+            ok = false;
+            return 0;
+        }
+        return data[pos++];
+    }
+
+    Uint16 u16() {
+        Uint16 low = u8();
+        return static_cast<Uint16>(low | (u8() << 8));
+    }
+
+    Uint32 u24() {
+        Uint32 low = u16();
+        return low | (static_cast<Uint32>(u8()) << 16);
+    }
+
+    Uint32 u32() {
+        Uint32 low = u16();
+        return low | (static_cast<Uint32>(u16()) << 16);
+    }
+
+    Uint32 varint() {
+        Uint32 value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            Uint8 byte = u8();
+            value |= static_cast<Uint32>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+};
+
+const Uint16 NET_PROTOCOL = 0xBC01;
+const int NET_MAX_PACKET = 65507;
+const Uint32 NET_MAX_SNAPSHOT = 1 << 16;
+const int NET_SNAPSHOT_HISTORY = 32;
+const int NET_INPUT_REDUNDANCY = 8;
+const Uint32 NET_TIMEOUT_MS = 5000;
+
+enum NetMessage {
+    NET_HELLO = 1,
+    NET_WELCOME,
+    NET_FULL,
+    NET_INPUT,
+    NET_SNAPSHOT,
+    NET_BYE
+};
+
+struct NetTank {
+    int x, y;
+    Uint8 direction;
+    bool alive;
+    bool invincible;
+    int health;
+};
+
+struct NetEntity {
+    Uint16 id;  // enemy slot or bullet index, which pairs an entity up across snapshots
+    int x, y;
+    Uint8 direction;
+    Uint8 extra;  // frozen flag for enemies, owner for bullets
+};
+
+// World state as the server sends it. Positions are whole pixels packed 12 bits per axis and health goes in
+// steps of 4, so a tank, an enemy and a bullet each take 5 bytes. The map and sub-cell masks sit at a fixed
+// offset ahead of the entity lists so that unchanged walls line up with the baseline and delta away.
+struct NetSnapshot {
+    Uint8 state;
+    Uint32 score;
+    Uint16 wave;
+    NetTank tanks[MAX_PLAYERS];
+    Uint8 powerUpType;
+    int powerUpX, powerUpY;
+    Uint8 map[MAP_ROWS][MAP_COLS];
+    Uint16 masks[MAP_ROWS][MAP_COLS];
+    std::vector<NetEntity> enemies;
+    std::vector<NetEntity> bullets;
+
+    // 12 bits per axis while the world fits in 4096 pixels, 16 bits otherwise.
+    static const bool WIDE_POSITIONS = WORLD_WIDTH >= 4096 || WORLD_HEIGHT >= 4096;
+    static constexpr int POSITION_BYTES = WIDE_POSITIONS ? 4 : 3;
+    // What write() produces with every enemy and bullet slot in use.
+    static constexpr int MAX_BYTES = 1 + 4 + 2 + MAX_PLAYERS * (POSITION_BYTES + 2) + 1 + POSITION_BYTES +
+                                     MAP_ROWS * MAP_COLS * 3 + 2 + MAX_ENEMIES * (2 + POSITION_BYTES) + 2 +
+                                     MAX_BULLETS * (2 + POSITION_BYTES);
+
+    static void writePosition(NetWriter& out, int x, int y) {
+        if (WIDE_POSITIONS) {
+            out.u16(static_cast<Uint16>(std::max(0, std::min(x, 65535))));
+            out.u16(static_cast<Uint16>(std::max(0, std::min(y, 65535))));
+            return;
+        }
+        Uint32 qx = static_cast<Uint32>(std::max(0, std::min(x, 4095)));
+        Uint32 qy = static_cast<Uint32>(std::max(0, std::min(y, 4095)));
+        out.u24(qx | (qy << 12));
+    }
+
+    static void readPosition(NetReader& in, int& x, int& y) {
+        if (WIDE_POSITIONS) {
+            x = in.u16();
+            y = in.u16();
+            return;
+        }
+        Uint32 packed = in.u24();
+        x = static_cast<int>(packed & 0xFFF);
+        y = static_cast<int>(packed >> 12);
+    }
+
+    void write(std::vector<Uint8>& bytes) const {
+        bytes.clear();
+        NetWriter out(bytes);
+        out.u8(state);
+        out.u32(score);
+        out.u16(wave);
+        for (const NetTank& tank : tanks) {
+            writePosition(out, tank.x, tank.y);
+            out.u8(static_cast<Uint8>(tank.direction | (tank.alive << 2) | (tank.invincible << 3)));
+            out.u8(static_cast<Uint8>(std::max(0, std::min(tank.health, 1020)) / 4));
+        }
+        out.u8(powerUpType);
+        writePosition(out, powerUpX, powerUpY);
+        for (int row = 0; row < MAP_ROWS; ++row) {
+            for (int col = 0; col < MAP_COLS; ++col) out.u8(map[row][col]);
+        }
+        for (int row = 0; row < MAP_ROWS; ++row) {
+            for (int col = 0; col < MAP_COLS; ++col) out.u16(masks[row][col]);
+        }
+        out.u16(static_cast<Uint16>(enemies.size()));
+        for (const NetEntity& enemy : enemies) {
+            out.u16(static_cast<Uint16>(enemy.id | (enemy.direction << 10) | (enemy.extra << 12)));
+            writePosition(out, enemy.x, enemy.y);
+        }
+        out.u16(static_cast<Uint16>(bullets.size()));
+        for (const NetEntity& bullet : bullets) {
+            out.u16(static_cast<Uint16>(bullet.id | (bullet.extra << 12) | (bullet.direction << 14)));
+            writePosition(out, bullet.x, bullet.y);
+        }
+    }
+
+    bool read(const std::vector<Uint8>& bytes) {
+        NetReader in(bytes.data(), bytes.size());
+        state = in.u8();
+        score = in.u32();
+        wave = in.u16();
+        for (NetTank& tank : tanks) {
+            readPosition(in, tank.x, tank.y);
+            Uint8 flags = in.u8();
+            tank.direction = flags & 3;
+            tank.alive = (flags >> 2) & 1;
+            tank.invincible = (flags >> 3) & 1;
+            tank.health = in.u8() * 4;
+        }
+        powerUpType = in.u8();
+        readPosition(in, powerUpX, powerUpY);
+        for (int row = 0; row < MAP_ROWS; ++row) {
+            for (int col = 0; col < MAP_COLS; ++col) map[row][col] = in.u8();
+        }
+        for (int row = 0; row < MAP_ROWS; ++row) {
+            for (int col = 0; col < MAP_COLS; ++col) masks[row][col] = in.u16();
+        }
+        enemies.resize(std::min<int>(in.u16(), MAX_ENEMIES));
+        for (NetEntity& enemy : enemies) {
+            Uint16 bits = in.u16();
+            enemy.id = bits & 0x3FF;
+            enemy.direction = (bits >> 10) & 3;
+            enemy.extra = (bits >> 12) & 1;
+            readPosition(in, enemy.x, enemy.y);
+        }
+        bullets.resize(std::min<int>(in.u16(), MAX_BULLETS));
+        for (NetEntity& bullet : bullets) {
+            Uint16 bits = in.u16();
+            bullet.id = bits & 0xFFF;
+            bullet.extra = (bits >> 12) & 3;
+            bullet.direction = (bits >> 14) & 3;
+            readPosition(in, bullet.x, bullet.y);
+        }
+        return in.ok && in.atEnd();
+    }
+};
+
+// A snapshot travels as its XOR against a baseline the receiver already holds (or against zeros), written as
+// alternating runs: zero count, literal count, literal bytes. State that did not change costs a few bytes.
+inline void netDeltaEncode(const std::vector<Uint8>& current, const std::vector<Uint8>* baseline, NetWriter& out) {
+    size_t size = current.size();
+    auto delta = [&](size_t i) -> Uint8 {
+        return current[i] ^ (baseline && i < baseline->size() ? (*baseline)[i] : 0);
+    };
+    out.varint(static_cast<Uint32>(size));
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = 0;
+        while (i + zeros < size && delta(i + zeros) == 0) zeros++;
+        size_t start = i + zeros;
+        size_t literals = 0;
+        // A lone unchanged byte between changed ones is cheaper inline than as a new run.
+        while (start + literals < size &&
+               (delta(start + literals) != 0 || (start + literals + 1 < size && delta(start + literals + 1) != 0))) {
+            literals++;
+        }
+        out.varint(static_cast<Uint32>(zeros));
+        out.varint(static_cast<Uint32>(literals));
+        for (size_t k = 0; k < literals; ++k) out.u8(delta(start + k));
+        i = start + literals;
+    }
+}
+
+// Upper bound on what netDeltaEncode() writes for a snapshot of the given size. Runs only break on two or more
+// zeros, which their count encodes in fewer bytes, so only the length varints of runs of 128 literals or more
+// and the runs at either end add to the size.
+inline size_t netDeltaMaxBytes(size_t size) {
+    return size + size / 128 + 8;
+}
+
+inline bool netDeltaDecode(NetReader& in, const std::vector<Uint8>* baseline, std::vector<Uint8>& current) {
+    Uint32 size = in.varint();
+    if (!in.ok || size > NET_MAX_SNAPSHOT) return false;
+    current.assign(size, 0);
+    Uint32 i = 0;
+    while (i < size) {
+        Uint32 zeros = in.varint();
+        Uint32 literals = in.varint();
+        if (!in.ok || zeros + literals == 0 || zeros > size - i || literals > size - i - zeros) return false;
+        i += zeros;
+        for (Uint32 k = 0; k < literals; ++k) current[i++] = in.u8();
+    }
+    if (!in.ok || !in.atEnd()) return false;
+    if (baseline) {
+        size_t common = std::min(current.size(), baseline->size());
+        for (size_t k = 0; k < common; ++k) current[k] ^= (*baseline)[k];
+    }
+    return true;
+}
+
+enum ReplayMode {
+    REPLAY_OFF,
+    REPLAY_RECORD,
+    REPLAY_PLAYBACK
+};
+
+enum SoundId {
+    SOUND_SHOOT,
+    SOUND_EXPLOSION,
+    SOUND_POWERUP,
+    SOUND_COUNT
+};
+
+// Sound requests from the simulation collect here and go to the mixer once per frame. Repeats of a sound
+// within the frame merge into one voice at full channel volume, the same as a single request. Each sound has
+// a voice cap and a priority: a capped sound restarts its own oldest voice, and when every channel is busy a
+// sound may take the oldest voice of a lower-priority one. However many enemies die at once, the mixer sees
+// at most SOUND_COUNT starts per frame on MAX_VOICES channels.
+class SoundQueue {
+public:
+    static constexpr int MAX_VOICES = 8;
+
+    Mix_Chunk* chunks[SOUND_COUNT];
+    int priority[SOUND_COUNT];
+    int voiceCap[SOUND_COUNT];
+    bool pending[SOUND_COUNT];
+    int channelSound[MAX_VOICES];
+    Uint32 channelStarted[MAX_VOICES];
+    Uint32 frame;
+
+    SoundQueue() : frame(0) {
+        for (int id = 0; id < SOUND_COUNT; ++id) {
+            chunks[id] = nullptr;
+            priority[id] = 0;
+            voiceCap[id] = 1;
+            pending[id] = false;
+        }
+        for (int channel = 0; channel < MAX_VOICES; ++channel) {
+            channelSound[channel] = -1;
+            channelStarted[channel] = 0;
+        }
+    }
+
+    void open() {
+        Mix_AllocateChannels(MAX_VOICES);
+    }
+
+    void setSound(SoundId id, Mix_Chunk* chunk, int soundPriority, int maxVoices) {
+        chunks[id] = chunk;
+        priority[id] = soundPriority;
+        voiceCap[id] = std::max(1, std::min(maxVoices, MAX_VOICES));
+    }
+
+    // Without a loaded chunk (headless runs, missing files) requests are dropped right away.
+    void play(SoundId id) {
+        if (chunks[id]) pending[id] = true;
+    }
+
+    int pickChannel(int id) const {
+        int voices = 0;
+        int oldestOwn = -1;
+        int freeChannel = -1;
+        int victim = -1;
+        for (int channel = 0; channel < MAX_VOICES; ++channel) {
+            int sound = Mix_Playing(channel) ? channelSound[channel] : -1;
+            if (sound < 0) {
+                if (freeChannel < 0) freeChannel = channel;
+            } else if (sound == id) {
+                voices++;
+                if (oldestOwn < 0 || channelStarted[channel] < channelStarted[oldestOwn]) oldestOwn = channel;
+            } else if (priority[sound] < priority[id] &&
+                       (victim < 0 || priority[sound] < priority[channelSound[victim]] ||
+                        (priority[sound] == priority[channelSound[victim]] &&
+                         channelStarted[channel] < channelStarted[victim]))) {
+                victim = channel;
+            }
+        }
+        if (voices >= voiceCap[id]) return oldestOwn;
+        if (freeChannel >= 0) return freeChannel;
+        if (victim >= 0) return victim;
+        return oldestOwn;
+    }
+
+    void dispatch() {
+        frame++;
+        for (int pass = 0; pass < SOUND_COUNT; ++pass) {
+            // Highest priority first, so it gets the pick of the channels.
+            int id = -1;
+            for (int s = 0; s < SOUND_COUNT; ++s) {
+                if (pending[s] && (id < 0 || priority[s] > priority[id])) id = s;
+            }
+            if (id < 0) break;
+            pending[id] = false;
+
+            int channel = pickChannel(id);
+            if (channel < 0) continue;
+            Mix_HaltChannel(channel);
+            Mix_Volume(channel, MIX_MAX_VOLUME);
+            if (Mix_PlayChannel(channel, chunks[id], 0) >= 0) {
+                channelSound[channel] = id;
+                channelStarted[channel] = frame;
+            }
+        }
+    }
+
+    void clear() {
+        std::fill(pending, pending + SOUND_COUNT, false);
+    }
+};
+
+// Everything the simulation mutates. Game owns one and the simulation works on it directly. A snapshot copies
+// the fixed part verbatim and only the used prefixes of the pools, a few KB for an ordinary wave, so the pools
+// have to stay the last members; anything declared above them is saved without further work.
+struct WorldState {
+    Uint32 simTicks;
+    Uint32 simTime;
+    Uint32 seed;
+    Random rng;
+    GameState state;
+    int score;
+    int waveNumber;
+    int currentLevel;  // index into Game::levels, -1 for the built-in map, -2 when no map is loaded yet
+    Uint32 terrainRevision;
+    Uint32 lastPowerUpSpawnTime;
+    bool hasPlayer[MAX_PLAYERS];
+    PlayerTank players[MAX_PLAYERS];
+    PowerUp powerUp;
+    Uint8 map[MAP_ROWS][MAP_COLS];
+    CollisionGrid collision;
+    EnemyPool enemies;
+    BulletPool bullets;
+
+    WorldState(Uint32 seedValue = 1) : simTicks(0), simTime(0), seed(seedValue), rng(seedValue), state(STATE_MENU),
+                                       score(0), waveNumber(1), currentLevel(-1), terrainRevision(0),
+                                       lastPowerUpSpawnTime(0) {
+        for (bool& present : hasPlayer) present = false;
+    }
+
+    static size_t fixedBytes();
+
+    void saveTo(std::vector<Uint8>& out) const {
+        out.clear();
+        appendBytes(out, reinterpret_cast<const Uint8*>(this), static_cast<int>(fixedBytes()));
+        enemies.saveTo(out);
+        bullets.saveTo(out);
+    }
+
+    // Restores exactly what saveTo() wrote, down to the pools' free-list order.
+    void restoreFrom(const std::vector<Uint8>& snapshot) {
+        const Uint8* in = snapshot.data();
+        takeBytes(in, reinterpret_cast<Uint8*>(this), static_cast<int>(fixedBytes()));
+        enemies.restoreFrom(in);
+        bullets.restoreFrom(in);
+    }
+};
+
+static_assert(std::is_trivially_copyable<WorldState>::value, "WorldState must stay memcpy-able");
+static_assert(std::is_standard_layout<WorldState>::value, "WorldState is saved by offset");
+static_assert(offsetof(WorldState, enemies) < offsetof(WorldState, bullets) &&
+              offsetof(WorldState, bullets) + sizeof(BulletPool) == sizeof(WorldState),
+              "the pools must be the last members of WorldState");
+
+inline size_t WorldState::fixedBytes() {
+    return offsetof(WorldState, enemies);
+}
+
+// Fixed ring of per-tick snapshots. Slots keep their buffers, so capturing allocates nothing once warm.
+class WorldHistory {
+public:
+    std::vector<std::vector<Uint8>> ring;
+    int newest;
+    int count;
+
+    WorldHistory() : newest(-1), count(0) {}
+
+    void reset(int capacity) {
+        ring.clear();
+        ring.shrink_to_fit();
+        ring.resize(std::max(0, capacity));
+        newest = -1;
+        count = 0;
+    }
+
+    int capacity() const {
+        return static_cast<int>(ring.size());
+    }
+
+    // Forgets every snapshot but keeps the ring allocated.
+    void clear() {
+        newest = -1;
+        count = 0;
+    }
+
+    std::vector<Uint8>& push() {
+        newest = (newest + 1) % capacity();
+        count = std::min(count + 1, capacity());
+        return ring[newest];
+    }
+
+    // Drops the newest snapshots, up to ticks of them, and returns the oldest one dropped. It stays valid until
+    // the next push().
+    const std::vector<Uint8>* rewind(int ticks) {
+        if (count == 0 || ticks <= 0) return nullptr;
+        int steps = std::min(ticks, count);
+        int target = (newest - steps + 1 + capacity()) % capacity();
+        newest = (target - 1 + capacity()) % capacity();
+        count -= steps;
+        return &ring[target];
+    }
+};
+
+enum FramePacing {
+    PACING_VSYNC,    // present blocks until the next display refresh
+    PACING_TIMER,    // sleep to a fixed frame rate, spinning for the last millisecond
+    PACING_UNCAPPED
+};
+
+// Sleeps until the performance counter reaches deadline. SDL_Delay only has millisecond resolution and may
+// overshoot, so it stops a millisecond early and the rest is spun.
+inline void sleepUntil(Uint64 deadline) {
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+    const Uint64 spinMargin = frequency / 1000;
+    for (;;) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now >= deadline) return;
+        Uint64 left = deadline - now;
+        Uint32 sleepMs = static_cast<Uint32>(left > spinMargin ? (left - spinMargin) * 1000 / frequency : 0);
+        if (sleepMs > 0) {
+            SDL_Delay(sleepMs);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// A screen region and the world rect it shows; both have the same size.
+struct CameraView {
+    SDL_Rect viewport;
+    SDL_Rect world;
+};
+
+class Game {
+    friend class Benchmark;
+    friend class NetServer;
+    friend class NetClient;
+    friend class MatchRunner;
+
+private:
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    bool headless;
+    bool running;
+    int tickRate;
+    WorldState world;
+    const int maxCatchUpTicks = 5;
+    ReplayMode replayMode;
+    InputReplay replay;
+    std::string replayPath;
+    WorldHistory history;
+    std::vector<std::unique_ptr<Level>> levels;
+    FlowField flowFields[MAX_PLAYERS];
+    TerrainLayer terrain;
+    bool splitScreen;
+    std::vector<WallHit> wallHits;
+    int localPlayer;  // network clients only steer this tank, with the player 1 keys
+    FramePacing pacing;
+    int frameRate;  // PACING_TIMER only
+    WorkerPool workers;
+    std::vector<EnemyCommandBuffer> enemyCommands;
+    SpatialGrid enemyGrid;
+    int maxEnemiesPerWave;
+    GameTuning tuning;
 
     SDL_Rect onePlayerButton;
     SDL_Rect twoPlayersButton;
     SDL_Rect restartButton;
 
-    SDL_Texture* menuBackground;
+    AssetArchive archive;
+    AssetCache assets;
+    AssetLoader loader;
+    TextureHandle menuBackground;
     TTF_Font* font;
+    GlyphAtlas glyphAtlas;
+    TextMesh hudText;
+    TextMesh profileText;
+    Profiler profiler;
+    int hudScore;
+    int hudWave;
     SDL_Texture* onePlayerText;
     SDL_Texture* twoPlayersText;
     SDL_Texture* gameOverText;
@@ -518,59 +3230,64 @@ private:
     Mix_Chunk* shootSound;
     Mix_Chunk* explosionSound;
     Mix_Chunk* powerUpSound;
+    SoundQueue sounds;
 
-    SDL_Texture* buttonTexture;
-    SDL_Texture* brickWallTexture;
-    SDL_Texture* stoneWallTexture;
-    SDL_Texture* powerUpTexture;
+    TextureHandle buttonTexture;
+    SpriteAtlas sprites;
+    SpriteBatch spriteBatch;
 
-    int score;
-    int waveNumber;
-    const int baseEnemyCount = 1;
     const int scorePerEnemy = 100;
     const int waveBonus = 500;
 
 public:
-    Game() : window(nullptr), renderer(nullptr), running(true), player1(nullptr), player2(nullptr),
-             state(STATE_MENU), lastPowerUpSpawnTime(0), menuBackground(nullptr), font(nullptr),
+    Game(bool headlessMode = false, int ticksPerSecond = DEFAULT_TICK_RATE, Uint32 seedValue = 1,
+         const std::string& archivePath = "battlecity.bcpk") : window(nullptr),
+             renderer(nullptr), headless(headlessMode), running(true), tickRate(ticksPerSecond), world(seedValue),
+             replayMode(REPLAY_OFF), splitScreen(false), localPlayer(-1), pacing(PACING_VSYNC), frameRate(60),
+             maxEnemiesPerWave(10), font(nullptr), hudScore(-1), hudWave(-1),
              onePlayerText(nullptr), twoPlayersText(nullptr), gameOverText(nullptr),
              scoreText(nullptr), restartText(nullptr), backgroundMusic(nullptr),
-             shootSound(nullptr), explosionSound(nullptr), powerUpSound(nullptr),
-             buttonTexture(nullptr), brickWallTexture(nullptr),
-             stoneWallTexture(nullptr), powerUpTexture(nullptr), score(0), waveNumber(1) {
+             shootSound(nullptr), explosionSound(nullptr), powerUpSound(nullptr) {
+        onePlayerButton = {300, 200, 200, 50};
+        twoPlayersButton = {300, 300, 200, 50};
+        restartButton = {300, 400, 200, 50};
+        setTickRate(ticksPerSecond);
+
+        if (headless) return;
+
         SDL_Init(SDL_INIT_VIDEO);
         IMG_Init(IMG_INIT_PNG);
         TTF_Init();
         Mix_Init(MIX_INIT_MP3 | MIX_INIT_OGG);
         Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048);
+        sounds.open();
 
         window = SDL_CreateWindow("Battle City", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-
-        onePlayerButton = {300, 200, 200, 50};
-        twoPlayersButton = {300, 300, 200, 50};
-        restartButton = {300, 400, 200, 50};
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+        assets.renderer = renderer;
+        assets.archive = &archive;
+        if (!archive.open(archivePath)) {
+            std::cout << "No asset archive at " << archivePath << ", loading loose files" << std::endl;
+        }
 
+        // Only the menu loads up front; everything else decodes in the background behind a progress bar.
         loadMenuResources();
+        world.state = STATE_LOADING;
         loadMusic();
         loadSounds();
-        loadPowerUpTexture();
-        powerUp.texture = powerUpTexture;
-
-        srand(time(0));
+        loadGameTextures();
+        loader.start(std::max(1, std::min(4, static_cast<int>(std::thread::hardware_concurrency()))));
     }
 
     ~Game() {
+        // Anything loaded but not yet finished is still owned by its member and freed below.
+        loader.wait();
         freeMenuResources();
         freeSounds();
-        if (player1) delete player1;
-        if (player2) delete player2;
-        for (auto enemy : enemies) delete enemy;
+        if (headless) return;
         if (backgroundMusic) Mix_FreeMusic(backgroundMusic);
-        if (buttonTexture) SDL_DestroyTexture(buttonTexture);
-        if (brickWallTexture) SDL_DestroyTexture(brickWallTexture);
-        if (stoneWallTexture) SDL_DestroyTexture(stoneWallTexture);
-        if (powerUpTexture) SDL_DestroyTexture(powerUpTexture);
+        sprites.release();
+        assets.clear();
         Mix_CloseAudio();
         Mix_Quit();
         SDL_DestroyRenderer(renderer);
@@ -581,20 +3298,21 @@ public:
     }
 
     void loadMenuResources() {
-        SDL_Surface* bgSurface = IMG_Load("nenmenu.jpg");
-        if (!bgSurface) {
-            std::cerr << "Failed to load menu background: " << IMG_GetError() << std::endl;
-            return;
-        }
-        menuBackground = SDL_CreateTextureFromSurface(renderer, bgSurface);
-        SDL_FreeSurface(bgSurface);
+        menuBackground = assets.getTexture("nenmenu.jpg");
+        if (!menuBackground) return;
 
-        font = TTF_OpenFont("C:/Windows/Fonts/arial.ttf", 24);
+        font = TTF_OpenFontRW(archive.openAsset(ARCHIVE_FONT), 1, 24);
+        for (const char* path : SYSTEM_FONTS) {
+            if (font) break;
+            font = TTF_OpenFont(path, 24);
+        }
         if (!font) {
             std::cerr << "Failed to load font: " << TTF_GetError() << std::endl;
             return;
         }
 
+        glyphAtlas.build(renderer, font);
+
         SDL_Color white = {255, 255, 255, 255};
         onePlayerText = createTextTexture("1 Player", white);
         twoPlayersText = createTextTexture("2 Players", white);
@@ -606,94 +3324,80 @@ public:
         gameOverTextRect = {SCREEN_WIDTH/2 - 100, 200, 200, 50};
         restartTextRect = {restartButton.x + 50, restartButton.y + 10, 100, 30};
 
-        SDL_Surface* buttonSurface = IMG_Load("khungmenu.jpg");
-        if (!buttonSurface) {
-            std::cerr << "Failed to load button texture: " << IMG_GetError() << std::endl;
-            return;
-        }
-        buttonTexture = SDL_CreateTextureFromSurface(renderer, buttonSurface);
-        SDL_FreeSurface(buttonSurface);
-
-        SDL_Surface* brickSurface = IMG_Load("wall.png");
-        if (!brickSurface) {
-            std::cerr << "Failed to load brick wall texture: " << IMG_GetError() << std::endl;
-        } else {
-            brickWallTexture = SDL_CreateTextureFromSurface(renderer, brickSurface);
-            SDL_FreeSurface(brickSurface);
-        }
+        buttonTexture = assets.getTexture("khungmenu.jpg");
+    }
 
-        SDL_Surface* stoneSurface = IMG_Load("wall.png");
-        if (!stoneSurface) {
-            std::cerr << "Failed to load stone wall texture: " << IMG_GetError() << std::endl;
+    Mix_Chunk* loadChunk(const char* path, const char* name, int volume) const {
+        Mix_Chunk* chunk = Mix_LoadWAV_RW(archive.openAsset(path), 1);
+        if (!chunk) {
+            std::cerr << "Failed to load " << name << " sound: " << Mix_GetError() << std::endl;
         } else {
-            stoneWallTexture = SDL_CreateTextureFromSurface(renderer, stoneSurface);
-            SDL_FreeSurface(stoneSurface);
+            Mix_VolumeChunk(chunk, volume);
         }
+        return chunk;
     }
 
+    // Loader jobs write their own members only; the game reads them once the loading state has ended.
+    // Power-ups are rare and matter most; shots are constant and matter least.
     void loadSounds() {
-        shootSound = Mix_LoadWAV("shoot.mp3");
-        if (!shootSound) {
-            std::cerr << "Failed to load shoot sound: " << Mix_GetError() << std::endl;
-        } else {
-            Mix_VolumeChunk(shootSound, MIX_MAX_VOLUME / 8);
-        }
-
-        explosionSound = Mix_LoadWAV("explosion.mp3");
-        if (!explosionSound) {
-            std::cerr << "Failed to load explosion sound: " << Mix_GetError() << std::endl;
-        } else {
-            Mix_VolumeChunk(explosionSound, MIX_MAX_VOLUME / 4);
-        }
+        loader.add([this] { shootSound = loadChunk("shoot.mp3", "shoot", MIX_MAX_VOLUME / 8); },
+                   [this] { sounds.setSound(SOUND_SHOOT, shootSound, 0, 3); });
+        loader.add([this] { explosionSound = loadChunk("explosion.mp3", "explosion", MIX_MAX_VOLUME / 4); },
+                   [this] { sounds.setSound(SOUND_EXPLOSION, explosionSound, 1, 4); });
+        loader.add([this] { powerUpSound = loadChunk("powerup.mp3", "powerup", MIX_MAX_VOLUME / 2); },
+                   [this] { sounds.setSound(SOUND_POWERUP, powerUpSound, 2, 2); });
+    }
 
-        powerUpSound = Mix_LoadWAV("powerup.mp3");
-        if (!powerUpSound) {
-            std::cerr << "Failed to load powerup sound: " << Mix_GetError() << std::endl;
-        } else {
-            Mix_VolumeChunk(powerUpSound, MIX_MAX_VOLUME / 2);
-        }
+    void loadGameTextures() {
+        static const char* const spritePaths[SPRITE_COUNT] = {
+            "tank.png", "tankenemy.png", "bullet.png", "wall.png", "wall.png", "powerup.png", nullptr
+        };
+        loader.add([this] { sprites.pack(spritePaths, archive); }, [this] {
+            sprites.upload(renderer);
+            terrain.invalidateAll();
+        });
     }
 
-    void loadPowerUpTexture() {
-        SDL_Surface* surface = IMG_Load("powerup.png");
-        if (!surface) {
-            std::cerr << "Failed to load powerup texture: " << IMG_GetError() << std::endl;
-        } else {
-            powerUpTexture = SDL_CreateTextureFromSurface(renderer, surface);
-            SDL_FreeSurface(surface);
-        }
+    void pollLoading() {
+        if (world.state != STATE_LOADING || !loader.poll()) return;
+        world.state = STATE_MENU;
+        if (replayMode == REPLAY_PLAYBACK) startGame(static_cast<GameState>(replay.mode));
     }
 
     void freeMenuResources() {
-        if (menuBackground) SDL_DestroyTexture(menuBackground);
+        menuBackground.reset();
+        buttonTexture.reset();
         if (onePlayerText) SDL_DestroyTexture(onePlayerText);
         if (twoPlayersText) SDL_DestroyTexture(twoPlayersText);
         if (gameOverText) SDL_DestroyTexture(gameOverText);
         if (scoreText) SDL_DestroyTexture(scoreText);
         if (restartText) SDL_DestroyTexture(restartText);
-        if (buttonTexture) SDL_DestroyTexture(buttonTexture);
-        if (brickWallTexture) SDL_DestroyTexture(brickWallTexture);
-        if (stoneWallTexture) SDL_DestroyTexture(stoneWallTexture);
+        glyphAtlas.release();
+        terrain.release();
         if (font) TTF_CloseFont(font);
     }
 
     void freeSounds() {
+        if (!headless) Mix_HaltChannel(-1);
         if (shootSound) Mix_FreeChunk(shootSound);
         if (explosionSound) Mix_FreeChunk(explosionSound);
         if (powerUpSound) Mix_FreeChunk(powerUpSound);
     }
 
     void loadMusic() {
-        backgroundMusic = Mix_LoadMUS("nhacnen.mp3");
-        if (!backgroundMusic) {
-            std::cerr << "Failed to load background music: " << Mix_GetError() << std::endl;
-        } else {
+        loader.add([this] {
+            // Music streams from the RWops while it plays, which is fine: the mapping outlives it.
+            backgroundMusic = Mix_LoadMUS_RW(archive.openAsset("nhacnen.mp3"), 1);
+            if (!backgroundMusic) std::cerr << "Failed to load background music: " << Mix_GetError() << std::endl;
+        }, [this] {
+            if (!backgroundMusic) return;
             Mix_VolumeMusic(MIX_MAX_VOLUME / 2);
             Mix_PlayMusic(backgroundMusic, -1);
-        }
+        });
     }
 
     SDL_Texture* createTextTexture(const char* text, SDL_Color color) {
+        if (!font) return nullptr;
         SDL_Surface* surface = TTF_RenderText_Solid(font, text, color);
         if (!surface) {
             std::cerr << "Failed to create text surface: " << TTF_GetError() << std::endl;
@@ -707,153 +3411,386 @@ public:
     void generateMap() {
         for (int row = 0; row < MAP_ROWS; ++row) {
             for (int col = 0; col < MAP_COLS; ++col) {
-                map[row][col] = 0;
+                world.map[row][col] = 0;
             }
         }
 
         for (int col = 0; col < MAP_COLS; ++col) {
-            map[0][col] = 1;
-            map[MAP_ROWS - 1][col] = 1;
+            world.map[0][col] = 1;
+            world.map[MAP_ROWS - 1][col] = 1;
         }
         for (int row = 0; row < MAP_ROWS; ++row) {
-            map[row][0] = 1;
-            map[row][MAP_COLS - 1] = 1;
-        }
-        map[3][8] = 2;
-        map[3][9] = 2;
-        map[3][12] = 2;
-        map[3][15] = 2;
-        map[5][4] = 2;
-        map[5][5] = 2;
-        map[6][4] = 2;
-        map[7][9] = 2;
-        map[7][12] = 2;
-        map[9][4] = 2;
-        map[9][5] = 2;
-        map[9][14] = 2;
-        map[10][8] = 2;
-        map[11][8] = 2;
-        map[12][5] = 2;
-        map[12][6] = 2;
-        map[12][7] = 2;
-        map[12][8] = 2;
-        map[12][12] = 2;
-        map[13][12] = 2;
-        map[14][15] = 2;
-        map[14][16] = 2;
-        map[15][5] = 2;
-        map[15][16] = 2;
-        map[16][10] = 2;
-        map[16][16] = 2;
+            world.map[row][0] = 1;
+            world.map[row][MAP_COLS - 1] = 1;
+        }
+        // The brick layout repeats every 20 tiles so larger worlds get the same density as a single screen.
+        static const int bricks[][2] = {
+            {3, 8}, {3, 9}, {3, 12}, {3, 15}, {5, 4}, {5, 5}, {6, 4}, {7, 9}, {7, 12}, {9, 4}, {9, 5}, {9, 14},
+            {10, 8}, {11, 8}, {12, 5}, {12, 6}, {12, 7}, {12, 8}, {12, 12}, {13, 12}, {14, 15}, {14, 16}, {15, 5},
+            {15, 16}, {16, 10}, {16, 16}
+        };
+        for (int blockRow = 0; blockRow + 1 < MAP_ROWS; blockRow += 20) {
+            for (int blockCol = 0; blockCol + 1 < MAP_COLS; blockCol += 20) {
+                for (const int* brick : bricks) {
+                    int row = blockRow + brick[0], col = blockCol + brick[1];
+                    if (row < MAP_ROWS - 1 && col < MAP_COLS - 1) world.map[row][col] = 2;
+                }
+            }
+        }
 
+        rebuildMapCaches();
+    }
 
-        for (int row = 0; row < MAP_ROWS; ++row) {
-            for (int col = 0; col < MAP_COLS; ++col) {
-                if (map[row][col] == 1 || map[row][col] == 2) {
-                    SDL_Rect wall = {col * GRID_SIZE, row * GRID_SIZE, GRID_SIZE, GRID_SIZE};
-                    walls.push_back(wall);
-                    wallBreakable.push_back(map[row][col] == 2);
+    bool addLevel(const std::string& path) {
+        std::unique_ptr<Level> level(new Level());
+        if (!level->load(path)) return false;
+        levels.push_back(std::move(level));
+        return true;
+    }
+
+    // Covers the contents and the rotation order of the loaded level files.
+    Uint32 levelListHash() const {
+        Uint32 hash = 2166136261u;
+        for (const std::unique_ptr<Level>& level : levels) hash = fnv1a(level->file.data, level->file.size, hash);
+        return hash;
+    }
+
+    // Levels rotate per wave; with none loaded the built-in world.map is used. Returns whether the world.map changed.
+    bool loadMapForWave() {
+        if (levels.empty()) {
+            if (world.currentLevel == -1) return false;
+            generateMap();
+            world.currentLevel = -1;
+            return true;
+        }
+        int index = (world.waveNumber - 1) % static_cast<int>(levels.size());
+        if (index == world.currentLevel) return false;
+        const Level& level = *levels[index];
+        memcpy(world.map, level.tiles, sizeof(world.map));
+        level.copyMasks(world.collision.mask);
+        world.terrainRevision++;
+        terrain.invalidateAll();
+        world.currentLevel = index;
+        return true;
+    }
+
+    bool levelPlayerSpawn(int player, int& x, int& y) const {
+        if (world.currentLevel < 0) return false;
+        const LevelSpawn& spawn = levels[world.currentLevel]->header->playerSpawns[player];
+        x = spawn.col * GRID_SIZE;
+        y = spawn.row * GRID_SIZE;
+        return true;
+    }
+
+    void moveToLevelSpawns() {
+        for (int p = 0; p < MAX_PLAYERS; ++p) {
+            PlayerTank& player = world.players[p];
+            int x, y;
+            if (!player.alive || !levelPlayerSpawn(p, x, y)) continue;
+            player.x = static_cast<float>(x);
+            player.y = static_cast<float>(y);
+            player.rect.x = player.prevX = x;
+            player.rect.y = player.prevY = y;
+        }
+        world.bullets.clear();
+    }
+
+    void exportBuiltinLevel(const std::string& path) {
+        generateMap();
+        world.currentLevel = -1;
+        LevelSpawn playerSpawns[MAX_PLAYERS] = {
+            {1, static_cast<Uint16>(MAP_ROWS - 2)},
+            {static_cast<Uint16>(MAP_COLS - 2), static_cast<Uint16>(MAP_ROWS - 2)}
+        };
+        std::vector<LevelSpawn> enemySpawns;
+        for (int row = 1; row < MAP_ROWS - 1; ++row) {
+            for (int col = 1; col < MAP_COLS - 1; ++col) {
+                if (!world.collision.isBlocked(row, col)) {
+                    enemySpawns.push_back({static_cast<Uint16>(col), static_cast<Uint16>(row)});
                 }
             }
         }
+        if (Level::write(path, world.map, playerSpawns, enemySpawns)) {
+            std::cout << "Wrote built-in level to " << path << std::endl;
+        }
+    }
+
+    void rebuildMapCaches() {
+        world.collision.build(world.map);
+        world.terrainRevision++;
+        terrain.invalidateAll();
+    }
+
+    // Stone is indestructible; a brick loses the hit sub-cells and only opens up for pathing once all are gone.
+    void chipBrick(const WallHit& hit) {
+        if (world.map[hit.row][hit.col] != 2) return;
+        terrain.markDirty(hit.row, hit.col);
+        if (world.collision.clearCells(hit.row, hit.col, hit.cells)) {
+            world.map[hit.row][hit.col] = 0;
+            world.terrainRevision++;
+        }
+    }
+
+    void updateBullets() {
+        wallHits.clear();
+        world.bullets.update(world.collision, wallHits, stepDistance(BULLET_SPEED, world.simTicks, tickRate));
+        for (const WallHit& hit : wallHits) chipBrick(hit);
     }
     bool isValidSpawn(int x, int y) {
     SDL_Rect rect = {x, y, GRID_SIZE, GRID_SIZE};
-    for (const auto& wall : walls) {
-        if (SDL_HasIntersection(&rect, &wall)) return false;
-    }
-    if (player1 && SDL_HasIntersection(&rect, &player1->rect)) return false;
-    if (player2 && SDL_HasIntersection(&rect, &player2->rect)) return false;
+    if (world.collision.overlapsSolid(rect)) return false;
+    if (player1() && SDL_HasIntersection(&rect, &player1()->rect)) return false;
+    if (player2() && SDL_HasIntersection(&rect, &player2()->rect)) return false;
     return true;
 }
 void generateEnemies() {
-    for (auto enemy : enemies) delete enemy;
-    enemies.clear();
-    int enemiesToSpawn = std::min(10, 1 + (waveNumber / 2));
+    world.enemies.clear();
+    int enemiesToSpawn = std::min(maxEnemiesPerWave, tuning.baseEnemies + world.waveNumber / tuning.wavesPerExtraEnemy);
     for (int i = 0; i < enemiesToSpawn; i++) {
         int x, y;
         bool validSpawn = false;
+        const Level* level = world.currentLevel >= 0 ? levels[world.currentLevel].get() : nullptr;
         for (int attempt = 0; attempt < 100; attempt++) {
-            x = (rand() % (MAP_COLS - 2)) * GRID_SIZE + GRID_SIZE;
-            y = (rand() % (MAP_ROWS - 2)) * GRID_SIZE + GRID_SIZE;
+            if (level && level->header->enemySpawnCount > 0) {
+                const LevelSpawn& spawn = level->enemySpawns[world.rng.nextInt(level->header->enemySpawnCount)];
+                x = spawn.col * GRID_SIZE;
+                y = spawn.row * GRID_SIZE;
+            } else {
+                x = world.rng.nextInt(MAP_COLS - 2) * GRID_SIZE + GRID_SIZE;
+                y = world.rng.nextInt(MAP_ROWS - 2) * GRID_SIZE + GRID_SIZE;
+            }
             if (isValidSpawn(x, y)) {
                 validSpawn = true;
                 break;
             }
         }
         if (validSpawn) {
-            PlayerTank* target = (rand() % 2 == 0 || !player2) ? player1 : player2;
-            enemies.push_back(new EnemyTank(renderer, x, y, target, shootSound, explosionSound));
+            int target = (world.rng.nextInt(2) == 0 || !player2()) ? 0 : 1;
+            world.enemies.spawn(x, y, target, world.rng);
         }
     }
 }
+    void setMaxEnemiesPerWave(int count) {
+        maxEnemiesPerWave = std::min(count, MAX_ENEMIES);
+    }
+
+    void setTuning(const GameTuning& values) {
+        tuning = values;
+        tuning.wavesPerExtraEnemy = std::max(1, tuning.wavesPerExtraEnemy);
+        world.enemies.setTiming(tickRate, tuning.enemyMoveDuration, tuning.enemyShootCooldown);
+    }
+
+    static bool validTickRate(int ticksPerSecond) {
+        return ticksPerSecond >= MIN_TICK_RATE && ticksPerSecond <= MAX_TICK_RATE;
+    }
+
+    // Only between games: world.simTime and the enemy timers are derived from it.
+    void setTickRate(int ticksPerSecond) {
+        tickRate = ticksPerSecond;
+        world.enemies.setTiming(tickRate, tuning.enemyMoveDuration, tuning.enemyShootCooldown);
+    }
+
+    void setWorkerThreads(int count) {
+        workers.start(count);
+    }
+
+    void startRecording(const std::string& path) {
+        replayMode = REPLAY_RECORD;
+        replayPath = path;
+    }
+
+    bool startPlayback(const std::string& path) {
+        if (!replay.load(path)) return false;
+        if (!validTickRate(static_cast<int>(replay.tickRate))) {
+            std::cerr << "Replay " << path << " has an unsupported tick rate of " << replay.tickRate << std::endl;
+            return false;
+        }
+        if (replay.levelCount != levels.size() || replay.levelHash != levelListHash()) {
+            std::cerr << "Replay " << path << " was recorded with other level files (" << replay.levelCount
+                      << "); pass the same --level files in the same order" << std::endl;
+            return false;
+        }
+        replayMode = REPLAY_PLAYBACK;
+        replayPath = path;
+        world.seed = replay.seed;
+        setTickRate(static_cast<int>(replay.tickRate));
+        setMaxEnemiesPerWave(static_cast<int>(replay.maxEnemiesPerWave));
+        setTuning(replay.tuning);
+        return true;
+    }
+
+    void finishRecording() {
+        if (replayMode != REPLAY_RECORD || replay.tickCount() == 0) return;
+        replay.finalHash = stateHash();
+        if (replay.save(replayPath)) {
+            std::cout << "Saved replay (" << replay.tickCount() << " ticks) to " << replayPath << std::endl;
+        }
+        replay.inputs.clear();
+    }
+
+    void applyReplayInput() {
+        if (replayMode == REPLAY_RECORD) {
+            replay.record(player1() ? player1()->getInput() : 0, player2() ? player2()->getInput() : 0);
+        } else if (replayMode == REPLAY_PLAYBACK) {
+            Uint8 input1 = 0, input2 = 0;
+            replay.inputAt(world.simTicks, input1, input2);
+            if (player1()) player1()->setInput(input1);
+            if (player2()) player2()->setInput(input2);
+        }
+    }
+
+    // The tanks in play; player 2 is null in single-player games and both are null on the menu.
+    PlayerTank* player1() {
+        return world.hasPlayer[0] ? &world.players[0] : nullptr;
+    }
+
+    PlayerTank* player2() {
+        return world.hasPlayer[1] ? &world.players[1] : nullptr;
+    }
+
+    const PlayerTank* player1() const {
+        return world.hasPlayer[0] ? &world.players[0] : nullptr;
+    }
+
+    const PlayerTank* player2() const {
+        return world.hasPlayer[1] ? &world.players[1] : nullptr;
+    }
+
+    // Restores the simulation exactly; caches derived from it (flow fields, the terrain texture) are rebuilt.
+    void restoreWorld(const std::vector<Uint8>& snapshot) {
+        world.restoreFrom(snapshot);
+        for (FlowField& field : flowFields) field.valid = false;
+        terrain.invalidateAll();
+    }
+
+    // The map is part of every snapshot, so large worlds get fewer seconds of history.
+    void setRewindSeconds(int seconds) {
+        const size_t budget = size_t(64) << 20;
+        int capacity = std::min(seconds * tickRate, static_cast<int>(budget / WorldState::fixedBytes()));
+        if (capacity < seconds * tickRate) {
+            std::cerr << "Rewind history limited to " << capacity << " ticks by its memory budget" << std::endl;
+        }
+        history.reset(capacity);
+    }
+
+    // Debug rewind: steps the world back by up to ticks ticks. Keys held right now stay held, and a recording
+    // drops the inputs of the ticks that were undone.
+    void rewind(int ticks) {
+        const std::vector<Uint8>* snapshot = history.rewind(ticks);
+        if (!snapshot) return;
+        PlayerTank live[MAX_PLAYERS];
+        memcpy(live, world.players, sizeof(world.players));
+        restoreWorld(*snapshot);
+        for (int p = 0; p < MAX_PLAYERS; ++p) {
+            memcpy(world.players[p].keys, live[p].keys, sizeof(live[p].keys));
+            world.players[p].fireRequested = false;
+        }
+        if (replayMode == REPLAY_RECORD && replay.inputs.size() > size_t(world.simTicks) * 2) {
+            replay.inputs.resize(size_t(world.simTicks) * 2);
+        }
+    }
+
+    Uint32 stateHash() const {
+        Uint32 hash = 2166136261u;
+        auto mix = [&hash](Uint32 value) {
+            for (int i = 0; i < 4; ++i) {
+                hash ^= (value >> (i * 8)) & 0xFF;
+                hash *= 16777619u;
+            }
+        };
+        mix(world.simTicks);
+        mix(world.score);
+        mix(world.waveNumber);
+        for (const PlayerTank* player : {player1(), player2()}) {
+            if (!player) continue;
+            mix(player->rect.x);
+            mix(player->rect.y);
+            mix(player->health);
+            mix(player->alive);
+        }
+        for (int i = 0; i < world.enemies.count; ++i) {
+            mix(world.enemies.x[i]);
+            mix(world.enemies.y[i]);
+            mix(world.enemies.direction[i]);
+        }
+        for (int i = 0; i < MAX_BULLETS; ++i) {
+            if (!world.bullets.isActive(i)) continue;
+            mix(i);
+            mix(world.bullets.x[i]);
+            mix(world.bullets.y[i]);
+        }
+        return hash;
+    }
+
     void checkWaveCompletion() {
-        if (enemies.empty()) {
-            waveNumber++;
-            score += waveBonus;
+        if (world.enemies.count == 0) {
+            world.waveNumber++;
+            world.score += waveBonus;
+            if (loadMapForWave()) moveToLevelSpawns();
             generateEnemies();
         }
     }
 
     void resetGame() {
-        walls.clear();
-        wallBreakable.clear();
-        for (auto enemy : enemies) delete enemy;
-        enemies.clear();
-        if (player1) delete player1;
-        if (player2) delete player2;
-
-        score = 0;
-        waveNumber = 1;
-        generateMap();
+        world.rng.seed(world.seed);
+        history.clear();
+        if (replayMode == REPLAY_RECORD) {
+            replay.begin(world.seed, tickRate, world.state, maxEnemiesPerWave, tuning,
+                         static_cast<Uint32>(levels.size()), levelListHash());
+        }
+        world.enemies.clear();
+        world.players[0] = PlayerTank();
+        world.players[1] = PlayerTank();
+        world.hasPlayer[0] = false;
+        world.hasPlayer[1] = false;
+        world.bullets.clear();
+
+        world.score = 0;
+        world.waveNumber = 1;
+        world.currentLevel = -2;
+        loadMapForWave();
 
         int player1X = GRID_SIZE;
-        int player1Y = SCREEN_HEIGHT - GRID_SIZE * 2;
+        int player1Y = WORLD_HEIGHT - GRID_SIZE * 2;
 
         SDL_Rect playerRect = {player1X, player1Y, GRID_SIZE, GRID_SIZE};
-        bool validPos = true;
-        for (const auto& wall : walls) {
-            if (SDL_HasIntersection(&playerRect, &wall)) {
-                validPos = false;
-                break;
-            }
-        }
+        bool validPos = !world.collision.overlapsSolid(playerRect);
 
         if (!validPos) {
             player1X = GRID_SIZE * 2;
-            player1Y = SCREEN_HEIGHT - GRID_SIZE * 3;
+            player1Y = WORLD_HEIGHT - GRID_SIZE * 3;
         }
 
-        player1 = new PlayerTank(renderer, player1X, player1Y, shootSound);
+        levelPlayerSpawn(0, player1X, player1Y);
+        world.players[0] = PlayerTank(OWNER_PLAYER1, player1X, player1Y);
+        world.hasPlayer[0] = true;
 
-        if (state == STATE_2P) {
-            int player2X = SCREEN_WIDTH - GRID_SIZE * 2;
-            int player2Y = SCREEN_HEIGHT - GRID_SIZE * 2;
+        if (world.state == STATE_2P) {
+            int player2X = WORLD_WIDTH - GRID_SIZE * 2;
+            int player2Y = WORLD_HEIGHT - GRID_SIZE * 2;
 
             playerRect = {player2X, player2Y, GRID_SIZE, GRID_SIZE};
-            validPos = true;
-            for (const auto& wall : walls) {
-                if (SDL_HasIntersection(&playerRect, &wall)) {
-                    validPos = false;
-                    break;
-                }
-            }
+            validPos = !world.collision.overlapsSolid(playerRect);
 
             if (!validPos) {
-                player2X = SCREEN_WIDTH - GRID_SIZE * 3;
-                player2Y = SCREEN_HEIGHT - GRID_SIZE * 3;
+                player2X = WORLD_WIDTH - GRID_SIZE * 3;
+                player2Y = WORLD_HEIGHT - GRID_SIZE * 3;
             }
 
-            player2 = new PlayerTank(renderer, player2X, player2Y, shootSound);
+            levelPlayerSpawn(1, player2X, player2Y);
+            world.players[1] = PlayerTank(OWNER_PLAYER2, player2X, player2Y);
+            world.hasPlayer[1] = true;
         }
 
         generateEnemies();
-        powerUp.active = false;
-        lastPowerUpSpawnTime = SDL_GetTicks();
+        world.powerUp.active = false;
+        world.simTicks = 0;
+        world.simTime = 0;
+        world.lastPowerUpSpawnTime = world.simTime;
     }
 
     PowerUpType getRandomPowerUpType() {
-        int random = rand() % 100;
+        int random = world.rng.nextInt(100);
         if (random < 30) return POWERUP_HEALTH;
         else if (random < 60) return POWERUP_FREEZE;
         else if (random < 90) return POWERUP_INVINCIBLE;
@@ -861,295 +3798,1421 @@ void generateEnemies() {
     }
 
     void spawnRandomPowerUp() {
-        if (powerUp.active) return;
-
-        Uint32 currentTime = SDL_GetTicks();
-        if (currentTime - lastPowerUpSpawnTime > powerUpSpawnInterval) {
-            int x = (rand() % (MAP_COLS - 2)) * GRID_SIZE + GRID_SIZE;
-            int y = (rand() % (MAP_ROWS - 2)) * GRID_SIZE + GRID_SIZE;
-
-            bool validPosition = true;
-            SDL_Rect powerUpRect = {x, y, GRID_SIZE, GRID_SIZE};
-            for (const auto& wall : walls) {
-                if (SDL_HasIntersection(&powerUpRect, &wall)) {
-                    validPosition = false;
-                    break;
-                }
-            }
+        if (world.powerUp.active) return;
 
-            if (validPosition) {
+        if (world.simTime - world.lastPowerUpSpawnTime > tuning.powerUpSpawnInterval) {
+            int x = world.rng.nextInt(MAP_COLS - 2) * GRID_SIZE + GRID_SIZE;
+            int y = world.rng.nextInt(MAP_ROWS - 2) * GRID_SIZE + GRID_SIZE;
+
+            SDL_Rect powerUpRect = {x, y, GRID_SIZE, GRID_SIZE};
+            if (!world.collision.overlapsSolid(powerUpRect)) {
                 PowerUpType type = getRandomPowerUpType();
-                powerUp.spawn(x, y, type);
-                lastPowerUpSpawnTime = currentTime;
+                world.powerUp.spawn(x, y, type, world.simTime);
+                world.lastPowerUpSpawnTime = world.simTime;
             }
         }
     }
 
     void checkPowerUpCollision() {
-        if (!powerUp.active) return;
+        if (!world.powerUp.active) return;
 
-        if (player1 && player1->alive && player1->checkPowerUpCollision(powerUp.rect)) {
-            applyPowerUpEffect(player1);
-            powerUp.active = false;
+        if (player1() && player1()->alive && player1()->checkPowerUpCollision(world.powerUp.rect)) {
+            applyPowerUpEffect(player1());
+            world.powerUp.active = false;
         }
-        else if (player2 && player2->alive && player2->checkPowerUpCollision(powerUp.rect)) {
-            applyPowerUpEffect(player2);
-            powerUp.active = false;
+        else if (player2() && player2()->alive && player2()->checkPowerUpCollision(world.powerUp.rect)) {
+            applyPowerUpEffect(player2());
+            world.powerUp.active = false;
         }
     }
 
     void applyPowerUpEffect(PlayerTank* player) {
-        if (powerUpSound) Mix_PlayChannel(-1, powerUpSound, 0);
-        switch (powerUp.type) {
+        sounds.play(SOUND_POWERUP);
+        switch (world.powerUp.type) {
             case POWERUP_HEALTH: player->heal(); break;
             case POWERUP_FREEZE: freezeAllEnemies(5000); break;
-            case POWERUP_INVINCIBLE: player->activateInvincible(5000); break;
+            case POWERUP_INVINCIBLE: player->activateInvincible(5000, world.simTime); break;
             case POWERUP_BOMB: destroyAllEnemies(); break;
             default: break;
         }
     }
 
     void freezeAllEnemies(Uint32 duration) {
-        for (auto enemy : enemies) {
-            enemy->freeze(duration);
-        }
+        world.enemies.freezeAll(duration, world.simTime);
     }
 
     void destroyAllEnemies() {
-        for (auto enemy : enemies) {
-            enemy->alive = false;
-            score += scorePerEnemy;
-            if (explosionSound) Mix_PlayChannel(-1, explosionSound, 0);
+        for (int i = 0; i < world.enemies.count; ++i) {
+            world.enemies.alive[i] = 0;
+            world.score += scorePerEnemy;
+            sounds.play(SOUND_EXPLOSION);
         }
-        enemies.erase(std::remove_if(enemies.begin(), enemies.end(), [](EnemyTank* e) {
-            if (!e->alive) { delete e; return true; }
-            return false;
-        }), enemies.end());
+        world.enemies.removeDead();
         checkWaveCompletion();
     }
 
-    void handleEvents() {
+    // Returns whether any event was handled.
+    bool handleEvents() {
+        bool handled = false;
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
+            handled = true;
             if (event.type == SDL_QUIT) {
                 running = false;
             }
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F3 && !event.key.repeat) {
+                profiler.overlayVisible = !profiler.overlayVisible;
+            }
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_BACKSPACE &&
+                (world.state == STATE_1P || world.state == STATE_2P) && replayMode != REPLAY_PLAYBACK) {
+                rewind(tickRate);
+            }
+            if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET) {
+                if (event.type == SDL_RENDER_DEVICE_RESET) terrain.release();
+                terrain.invalidateAll();
+            }
 
-            switch (state) {
+            switch (world.state) {
                 case STATE_MENU:
                     Mix_PauseMusic();
-                    if (event.type == SDL_MOUSEBUTTONDOWN) {
+                    if (event.type == SDL_MOUSEBUTTONDOWN && localPlayer < 0) {
                         int x = event.button.x;
                         int y = event.button.y;
 
                         if (x >= onePlayerButton.x && x <= onePlayerButton.x + onePlayerButton.w &&
                             y >= onePlayerButton.y && y <= onePlayerButton.y + onePlayerButton.h) {
-                            state = STATE_1P;
-                            resetGame();
-                            Mix_ResumeMusic();
+                            startGame(STATE_1P);
                         }
                         else if (x >= twoPlayersButton.x && x <= twoPlayersButton.x + twoPlayersButton.w &&
                                  y >= twoPlayersButton.y && y <= twoPlayersButton.y + twoPlayersButton.h) {
-                            state = STATE_2P;
-                            resetGame();
-                            Mix_ResumeMusic();
+                            startGame(STATE_2P);
                         }
                     }
                     break;
 
+                case STATE_LOADING:
+                    break;
+
                 case STATE_GAME_OVER:
-                    if (event.type == SDL_MOUSEBUTTONDOWN) {
+                    if (event.type == SDL_MOUSEBUTTONDOWN && localPlayer < 0) {
                         int x = event.button.x;
                         int y = event.button.y;
                         if (x >= restartButton.x && x <= restartButton.x + restartButton.w &&
                             y >= restartButton.y && y <= restartButton.y + restartButton.h) {
-                            state = STATE_MENU;
+                            world.state = STATE_MENU;
                         }
                     }
                     break;
 
                 case STATE_1P:
                 case STATE_2P:
-                    if (player1) player1->handleInput(event, true);
-                    if (player2) player2->handleInput(event, false);
+                    if (replayMode == REPLAY_PLAYBACK) break;
+                    if (localPlayer >= 0) {
+                        world.players[localPlayer].handleInput(event, true);
+                        break;
+                    }
+                    if (player1()) player1()->handleInput(event, true);
+                    if (player2()) player2()->handleInput(event, false);
                     break;
             }
         }
+        return handled;
     }
 
-    void update() {
-        if (state == STATE_1P || state == STATE_2P) {
-            if (player1) {
-                player1->update(walls, player2 ? &player2->rect : nullptr);
-                player1->updateBullets(walls, wallBreakable);
-            }
-            if (player2) {
-                player2->update(walls, &player1->rect);
-                player2->updateBullets(walls, wallBreakable);
-            }
-
-            for (auto enemy : enemies) {
-                enemy->update(walls, wallBreakable);
-                enemy->updateFreeze();
-                if (player1) {
-                    for (auto& bullet : enemy->bullets) {
-                        if (SDL_HasIntersection(&bullet.rect, &player1->rect)) {
-                            if (!player1->invincible) {
-                                player1->takeDamage();
-                                bullet.active = false;
-                                player1->activateInvincible(1000);
-                                if (explosionSound) Mix_PlayChannel(-1, explosionSound, 0);
-                            }
-                        }
-                    }
-                }
-                if (player2) {
-                    for (auto& bullet : enemy->bullets) {
-                        if (SDL_HasIntersection(&bullet.rect, &player2->rect)) {
-                            if (!player2->invincible) {
-                                player2->takeDamage();
-                                bullet.active = false;
-                                player2->activateInvincible(1000);
-                                if (explosionSound) Mix_PlayChannel(-1, explosionSound, 0);
-                            }
-                        }
-                    }
-                }
+    void setPacing(FramePacing mode, int framesPerSecond) {
+        pacing = mode;
+        frameRate = framesPerSecond;
+        if (frameRate <= 0) {
+            SDL_DisplayMode display;
+            bool known = window && SDL_GetWindowDisplayMode(window, &display) == 0 && display.refresh_rate > 0;
+            frameRate = known ? display.refresh_rate : 60;
+        }
+        if (renderer) SDL_RenderSetVSync(renderer, mode == PACING_VSYNC ? 1 : 0);
+    }
 
-                if (player1) {
-                    for (auto& bullet : player1->bullets) {
-                        if (SDL_HasIntersection(&bullet.rect, &enemy->rect)) {
-                            enemy->alive = false;
-                            bullet.active = false;
-                            score += scorePerEnemy;
-                            if (explosionSound) Mix_PlayChannel(-1, explosionSound, 0);
-                        }
-                    }
+    // Called after present; mark carries the schedule from frame to frame. Timer pacing sleeps to a fixed
+    // deadline. Under vsync, present has normally blocked already, but a driver that ignores vsync returns at
+    // once, so a frame shorter than half the target has the rest of it slept off instead of spinning a core.
+    void paceFrame(Uint64& mark) {
+        const Uint64 frequency = SDL_GetPerformanceFrequency();
+        const Uint64 frameLength = frequency / frameRate;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (pacing == PACING_TIMER) {
+            mark += frameLength;
+            if (now > mark + frameLength) {
+                mark = now;
+            } else {
+                sleepUntil(mark);
+            }
+        } else if (pacing == PACING_VSYNC) {
+            if (now - mark < frameLength / 2) {
+                SDL_Delay(static_cast<Uint32>((frameLength - (now - mark)) * 1000 / frequency));
+            }
+            mark = SDL_GetPerformanceCounter();
+        }
+    }
+
+    // Screens that only change on input; run() sleeps on the event queue instead of redrawing them.
+    bool isStaticScreen() const {
+        return world.state == STATE_MENU || world.state == STATE_GAME_OVER;
+    }
+
+    void startGame(GameState mode) {
+        world.state = mode;
+        resetGame();
+        Mix_ResumeMusic();
+    }
+
+    void update() {
+        if (world.state == STATE_1P || world.state == STATE_2P) {
+            if (history.capacity() > 0 && replayMode != REPLAY_PLAYBACK) world.saveTo(history.push());
+            applyReplayInput();
+            world.simTicks++;
+            world.simTime = static_cast<Uint32>(static_cast<Uint64>(world.simTicks) * 1000 / tickRate);
+            int shots = 0;
+            {
+                ProfileScope scope(profiler, PHASE_PLAYERS);
+                PlayerTank* first = player1();
+                PlayerTank* second = player2();
+                if (first && first->update(world.collision, world.bullets, world.simTime, tickRate,
+                                           second ? &second->rect : nullptr)) {
+                    shots++;
                 }
-                if (player2) {
-                    for (auto& bullet : player2->bullets) {
-                        if (SDL_HasIntersection(&bullet.rect, &enemy->rect)) {
-                            enemy->alive = false;
-                            bullet.active = false;
-                            score += scorePerEnemy;
-                            if (explosionSound) Mix_PlayChannel(-1, explosionSound, 0);
-                        }
-                    }
+                if (second && second->update(world.collision, world.bullets, world.simTime, tickRate, &first->rect)) {
+                    shots++;
                 }
             }
+            {
+                ProfileScope scope(profiler, PHASE_ENEMIES);
+                updateFlowFields();
+                shots += world.enemies.update(world.collision, world.players, flowFields, world.bullets, enemyCommands,
+                                              world.simTicks, world.simTime, &workers);
+            }
+            if (shots > 0) sounds.play(SOUND_SHOOT);
 
-            enemies.erase(std::remove_if(enemies.begin(), enemies.end(), [](EnemyTank* e) {
-                if (!e->alive) { delete e; return true; }
-                return false;
-            }), enemies.end());
+            {
+                ProfileScope scope(profiler, PHASE_COLLISION);
+                updateBullets();
+                checkBulletHits();
+                world.enemies.removeDead();
+            }
 
-            checkWaveCompletion();
-            spawnRandomPowerUp();
-            powerUp.update();
-            checkPowerUpCollision();
+            {
+                ProfileScope scope(profiler, PHASE_POWERUPS);
+                checkWaveCompletion();
+                spawnRandomPowerUp();
+                world.powerUp.update(world.simTime);
+                checkPowerUpCollision();
+            }
 
             bool gameOver = false;
-            if (state == STATE_1P && (!player1 || !player1->alive)) {
+            if (world.state == STATE_1P && (!player1() || !player1()->alive)) {
                 gameOver = true;
             }
-            else if (state == STATE_2P ) {
-               bool player1Dead = (!player1 || !player1->alive);
-        bool player2Dead = (!player2 || !player2->alive);
+            else if (world.state == STATE_2P ) {
+               bool player1Dead = (!player1() || !player1()->alive);
+        bool player2Dead = (!player2() || !player2()->alive);
         gameOver = (player1Dead && player2Dead);
             }
 
             if (gameOver) {
-                state = STATE_GAME_OVER;
+                world.state = STATE_GAME_OVER;
                 SDL_Color white = {255, 255, 255, 255};
                 char scoreStr[50];
-                sprintf(scoreStr, "Final Score: %d", score);
+                sprintf(scoreStr, "Final Score: %d", world.score);
                 if (scoreText) SDL_DestroyTexture(scoreText);
                 scoreText = createTextTexture(scoreStr, white);
                 scoreTextRect = {SCREEN_WIDTH/2 - 100, 300, 200, 30};
+                finishRecording();
+                world.seed = world.rng.next();
+            }
+
+            if (replayMode == REPLAY_PLAYBACK && world.simTicks == replay.tickCount()) {
+                Uint32 hash = stateHash();
+                std::cout << "Replay finished after " << world.simTicks << " ticks: "
+                          << (hash == replay.finalHash ? "state matches recording" : "STATE DIVERGED") << std::endl;
+                replayMode = REPLAY_OFF;
+            }
+        }
+    }
+
+    void updateFlowFields() {
+        for (int p = 0; p < MAX_PLAYERS; ++p) {
+            const PlayerTank& player = world.players[p];
+            if (!player.alive) continue;
+            int row = (player.rect.y + PlayerTank::height / 2) / GRID_SIZE;
+            int col = (player.rect.x + PlayerTank::width / 2) / GRID_SIZE;
+            if (!flowFields[p].isCurrent(row, col, world.terrainRevision)) {
+                flowFields[p].compute(world.collision, row, col, world.terrainRevision);
+            }
+        }
+    }
+
+    bool hitPlayer(PlayerTank* player, const SDL_Rect& bulletRect) {
+        if (!player || !player->alive || player->invincible) return false;
+        if (!SDL_HasIntersection(&bulletRect, &player->rect)) return false;
+        player->takeDamage();
+        player->activateInvincible(1000, world.simTime);
+        sounds.play(SOUND_EXPLOSION);
+        return true;
+    }
+
+    void checkBulletHits() {
+        enemyGrid.build(world.enemies.count, [&](int i) {
+            return SDL_Point{world.enemies.x[i], world.enemies.y[i]};
+        });
+
+        world.bullets.forEachActive([&](int i) {
+            SDL_Rect bulletRect = world.bullets.rectOf(i);
+            if (world.bullets.owner[i] == OWNER_ENEMY) {
+                if (hitPlayer(player1(), bulletRect) || hitPlayer(player2(), bulletRect)) world.bullets.despawn(i);
+                return;
+            }
+            int hit = -1;
+            enemyGrid.query(bulletRect, [&](int e) {
+                SDL_Rect enemyRect = world.enemies.rectOf(e);
+                if ((hit < 0 || e < hit) && world.enemies.alive[e] && SDL_HasIntersection(&bulletRect, &enemyRect)) {
+                    hit = e;
+                }
+            });
+            if (hit >= 0) {
+                world.enemies.alive[hit] = 0;
+                world.bullets.despawn(i);
+                world.score += scorePerEnemy;
+                sounds.play(SOUND_EXPLOSION);
+            }
+        });
+    }
+
+    static double angleOf(int direction) {
+        switch (direction) {
+            case 0: return 0;
+            case 1: return 270;
+            case 2: return 180;
+            case 3: return 90;
+            default: return 0;
+        }
+    }
+
+    void renderPlayer(const PlayerTank& player, float alpha, bool isPlayer1, const SDL_Rect& view) {
+        if (!player.alive) return;
+
+        SDL_Rect drawRect = {lerpInt(player.prevX, player.rect.x, alpha), lerpInt(player.prevY, player.rect.y, alpha),
+                             PlayerTank::width, PlayerTank::height};
+        if (!intersects(view, drawRect.x, drawRect.y - 10, PlayerTank::width, PlayerTank::height + 10)) return;
+        Uint8 tankAlpha = player.invincible && (SDL_GetTicks() / 100) % 2 == 0 ? 128 : 255;
+        spriteBatch.draw(SPRITE_PLAYER_TANK, drawRect, {255, 255, 255, tankAlpha}, angleOf(player.direction));
+
+        SDL_Rect healthBarBg = {drawRect.x, drawRect.y - 10, PlayerTank::width, 5};
+        spriteBatch.fillRect(healthBarBg, {255, 0, 0, 255});
+
+        SDL_Rect healthBar = {drawRect.x, drawRect.y - 10,
+                              (int)(PlayerTank::width * ((float)player.health / PlayerTank::maxHealth)), 5};
+        if (isPlayer1) {
+            spriteBatch.fillRect(healthBar, {0, 255, 0, 255});
+        } else {
+            spriteBatch.fillRect(healthBar, {0, 0, 255, 255});
+        }
+    }
+
+    void renderEnemies(float alpha, const SDL_Rect& view) {
+        for (int i = 0; i < world.enemies.count; ++i) {
+            if (!world.enemies.alive[i]) continue;
+            SDL_Rect drawRect = {lerpInt(world.enemies.prevX[i], world.enemies.x[i], alpha),
+                                 lerpInt(world.enemies.prevY[i], world.enemies.y[i], alpha), GRID_SIZE, GRID_SIZE};
+            if (!intersects(view, drawRect.x, drawRect.y, GRID_SIZE, GRID_SIZE)) continue;
+            SDL_Color tint = {255, 255, 255, static_cast<Uint8>(world.enemies.frozen[i] ? 128 : 255)};
+            spriteBatch.draw(SPRITE_ENEMY_TANK, drawRect, tint, angleOf(world.enemies.direction[i]));
+        }
+    }
+
+    static int cameraOffset(int center, int worldSize, int viewSize) {
+        if (worldSize <= viewSize) return (worldSize - viewSize) / 2;
+        return std::max(0, std::min(worldSize - viewSize, center - viewSize / 2));
+    }
+
+    static CameraView cameraView(const SDL_Rect& viewport, int centerX, int centerY) {
+        CameraView view;
+        view.viewport = viewport;
+        view.world = {cameraOffset(centerX, WORLD_WIDTH, viewport.w), cameraOffset(centerY, WORLD_HEIGHT, viewport.h),
+                      viewport.w, viewport.h};
+        return view;
+    }
+
+    // One view follows every tracked tank while they fit on screen together; otherwise the screen splits along
+    // the axis they are furthest apart on, and merges again once they are a couple of tiles closer. Network
+    // clients only track their own tank.
+    int computeViews(float alpha, CameraView views[MAX_PLAYERS]) {
+        SDL_Rect focus[MAX_PLAYERS];
+        int count = 0;
+        for (int pass = 0; pass < 2 && count == 0; ++pass) {
+            for (int p = 0; p < MAX_PLAYERS; ++p) {
+                const PlayerTank* player = p == 0 ? player1() : player2();
+                if (!player || (localPlayer >= 0 && p != localPlayer) || (pass == 0 && !player->alive)) continue;
+                focus[count++] = {lerpInt(player->prevX, player->rect.x, alpha),
+                                  lerpInt(player->prevY, player->rect.y, alpha), PlayerTank::width, PlayerTank::height};
+            }
+        }
+        SDL_Rect screen = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+        if (count == 0) {
+            splitScreen = false;
+            views[0] = cameraView(screen, WORLD_WIDTH / 2, WORLD_HEIGHT / 2);
+            return 1;
+        }
+
+        SDL_Rect bounds = focus[0];
+        for (int i = 1; i < count; ++i) SDL_UnionRect(&bounds, &focus[i], &bounds);
+        int margin = splitScreen ? GRID_SIZE * 2 : 0;
+        bool worldFits = WORLD_WIDTH <= SCREEN_WIDTH && WORLD_HEIGHT <= SCREEN_HEIGHT;
+        splitScreen = count > 1 && !worldFits &&
+                      (bounds.w + margin > SCREEN_WIDTH || bounds.h + margin > SCREEN_HEIGHT);
+        if (!splitScreen) {
+            views[0] = cameraView(screen, bounds.x + bounds.w / 2, bounds.y + bounds.h / 2);
+            return 1;
+        }
+
+        int dx = focus[1].x - focus[0].x, dy = focus[1].y - focus[0].y;
+        bool sideBySide = std::abs(dx) >= std::abs(dy);
+        int first = (sideBySide ? dx : dy) >= 0 ? 0 : 1;
+        SDL_Rect halves[2];
+        if (sideBySide) {
+            halves[0] = {0, 0, SCREEN_WIDTH / 2, SCREEN_HEIGHT};
+            halves[1] = {SCREEN_WIDTH / 2, 0, SCREEN_WIDTH - SCREEN_WIDTH / 2, SCREEN_HEIGHT};
+        } else {
+            halves[0] = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT / 2};
+            halves[1] = {0, SCREEN_HEIGHT / 2, SCREEN_WIDTH, SCREEN_HEIGHT - SCREEN_HEIGHT / 2};
+        }
+        for (int i = 0; i < 2; ++i) {
+            const SDL_Rect& target = focus[i == 0 ? first : 1 - first];
+            views[i] = cameraView(halves[i], target.x + target.w / 2, target.y + target.h / 2);
+        }
+        return 2;
+    }
+
+    void setProfileCsv(const std::string& path) {
+        // Headless runs outpace any writer, so stall the simulation rather than lose samples.
+        profiler.waitWhenFull = headless;
+        profiler.openCsv(path);
+    }
+
+    void renderProfileOverlay() {
+        if (!profiler.overlayVisible) return;
+        if (profiler.current.frame % 30 == 0 || profileText.indices.empty()) {
+            SDL_Color yellow = {255, 255, 0, 255};
+            int lineHeight = std::max(glyphAtlas.lineHeight, 1);
+            int y = SCREEN_HEIGHT - (PHASE_COUNT + 1) * lineHeight - 10;
+            profileText.clear();
+            glyphAtlas.appendText(profileText, "phase       p50 ms  p99 ms", SCREEN_WIDTH - 330, y, yellow);
+            for (int p = 0; p < PHASE_COUNT; ++p) {
+                char line[64];
+                ProfilePhase phase = static_cast<ProfilePhase>(p);
+                snprintf(line, sizeof(line), "%-10s %7.2f %7.2f", PHASE_NAMES[p], profiler.percentile(phase, 50),
+                         profiler.percentile(phase, 99));
+                glyphAtlas.appendText(profileText, line, SCREEN_WIDTH - 330, y + (p + 1) * lineHeight, yellow);
             }
         }
+        glyphAtlas.draw(renderer, profileText);
+    }
+
+    void renderHud() {
+        if (world.score != hudScore || world.waveNumber != hudWave) {
+            hudScore = world.score;
+            hudWave = world.waveNumber;
+            SDL_Color white = {255, 255, 255, 255};
+            char scoreStr[50];
+            char waveStr[50];
+            sprintf(scoreStr, "Score: %d", world.score);
+            sprintf(waveStr, "Wave: %d", world.waveNumber);
+            hudText.clear();
+            glyphAtlas.appendText(hudText, scoreStr, 10, 10, white);
+            glyphAtlas.appendText(hudText, waveStr, 10, 50, white);
+        }
+        glyphAtlas.draw(renderer, hudText);
     }
 
-    void render() {
+    void render(float alpha) {
+        ProfileScope renderScope(profiler, PHASE_RENDER);
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
 
-        switch (state) {
+        switch (world.state) {
             case STATE_MENU:
                 if (menuBackground) {
-                    SDL_RenderCopy(renderer, menuBackground, nullptr, nullptr);
+                    SDL_RenderCopy(renderer, menuBackground.get(), nullptr, nullptr);
                 }
                 if (buttonTexture) {
-                    SDL_RenderCopy(renderer, buttonTexture, nullptr, &onePlayerButton);
-                    SDL_RenderCopy(renderer, buttonTexture, nullptr, &twoPlayersButton);
+                    SDL_RenderCopy(renderer, buttonTexture.get(), nullptr, &onePlayerButton);
+                    SDL_RenderCopy(renderer, buttonTexture.get(), nullptr, &twoPlayersButton);
                 }
                 if (onePlayerText) SDL_RenderCopy(renderer, onePlayerText, nullptr, &onePlayerTextRect);
                 if (twoPlayersText) SDL_RenderCopy(renderer, twoPlayersText, nullptr, &twoPlayersTextRect);
                 break;
 
+            case STATE_LOADING: {
+                if (menuBackground) SDL_RenderCopy(renderer, menuBackground.get(), nullptr, nullptr);
+                SDL_Rect frame = {SCREEN_WIDTH / 4, SCREEN_HEIGHT / 2, SCREEN_WIDTH / 2, 20};
+                SDL_Rect bar = {frame.x + 2, frame.y + 2, static_cast<int>((frame.w - 4) * loader.progress()), frame.h - 4};
+                SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+                SDL_RenderDrawRect(renderer, &frame);
+                SDL_RenderFillRect(renderer, &bar);
+                break;
+            }
+
             case STATE_GAME_OVER:
                 if (gameOverText) SDL_RenderCopy(renderer, gameOverText, nullptr, &gameOverTextRect);
                 if (scoreText) SDL_RenderCopy(renderer, scoreText, nullptr, &scoreTextRect);
-                if (buttonTexture) SDL_RenderCopy(renderer, buttonTexture, nullptr, &restartButton);
+                if (buttonTexture) SDL_RenderCopy(renderer, buttonTexture.get(), nullptr, &restartButton);
                 if (restartText) SDL_RenderCopy(renderer, restartText, nullptr, &restartTextRect);
                 break;
 
             case STATE_1P:
-            case STATE_2P:
-                for (size_t i = 0; i < walls.size(); ++i) {
-                    if (wallBreakable[i] && brickWallTexture) {
-                        SDL_RenderCopy(renderer, brickWallTexture, nullptr, &walls[i]);
-                    } else if (stoneWallTexture) {
-                        SDL_RenderCopy(renderer, stoneWallTexture, nullptr, &walls[i]);
+            case STATE_2P: {
+                CameraView views[MAX_PLAYERS];
+                int viewCount = computeViews(alpha, views);
+                {
+                    ProfileScope scope(profiler, PHASE_TERRAIN);
+                    terrain.beginFrame();
+                    for (int v = 0; v < viewCount; ++v) {
+                        terrain.update(renderer, world.map, world.collision.mask, sprites, spriteBatch, views[v].world);
                     }
                 }
-                if (player1) player1->render(true);
-                if (player2) player2->render(false);
-                for (auto enemy : enemies) enemy->render();
-                powerUp.render(renderer);
-                SDL_Color white = {255, 255, 255, 255};
-                char scoreStr[50];
-                sprintf(scoreStr, "Score: %d", score);
-                SDL_Texture* scoreTexture = createTextTexture(scoreStr, white);
-                SDL_Rect scoreRect = {10, 10, 150, 30};
-                SDL_RenderCopy(renderer, scoreTexture, nullptr, &scoreRect);
-                SDL_DestroyTexture(scoreTexture);
-
-                char waveStr[50];
-                sprintf(waveStr, "Wave: %d", waveNumber);
-                SDL_Texture* waveTexture = createTextTexture(waveStr, white);
-                SDL_Rect waveRect = {10, 50, 150, 30};
-                SDL_RenderCopy(renderer, waveTexture, nullptr, &waveRect);
-                SDL_DestroyTexture(waveTexture);
+                for (int v = 0; v < viewCount; ++v) {
+                    const SDL_Rect& view = views[v].world;
+                    SDL_RenderSetViewport(renderer, &views[v].viewport);
+                    {
+                        ProfileScope scope(profiler, PHASE_TERRAIN);
+                        terrain.render(renderer, view);
+                    }
+                    ProfileScope scope(profiler, PHASE_ENTITIES);
+                    spriteBatch.begin(sprites, {view.x, view.y});
+                    if (player1()) renderPlayer(*player1(), alpha, true, view);
+                    if (player2()) renderPlayer(*player2(), alpha, false, view);
+                    renderEnemies(alpha, view);
+                    world.bullets.render(spriteBatch, alpha, view);
+                    const SDL_Rect& powerUpRect = world.powerUp.rect;
+                    if (intersects(view, powerUpRect.x, powerUpRect.y, powerUpRect.w, powerUpRect.h)) {
+                        world.powerUp.render(spriteBatch);
+                    }
+                    spriteBatch.flush(renderer);
+                }
+                SDL_RenderSetViewport(renderer, nullptr);
+                if (viewCount > 1) {
+                    SDL_Rect divider = views[1].viewport.x > 0 ? SDL_Rect{views[1].viewport.x - 1, 0, 2, SCREEN_HEIGHT}
+                                                               : SDL_Rect{0, views[1].viewport.y - 1, SCREEN_WIDTH, 2};
+                    SDL_SetRenderDrawColor(renderer, 128, 128, 128, 255);
+                    SDL_RenderFillRect(renderer, &divider);
+                }
+                ProfileScope scope(profiler, PHASE_HUD);
+                renderHud();
                 break;
+            }
         }
 
+        {
+            ProfileScope scope(profiler, PHASE_HUD);
+            renderProfileOverlay();
+        }
+        ProfileScope scope(profiler, PHASE_PRESENT);
         SDL_RenderPresent(renderer);
     }
 
+    void runHeadless(GameState mode, Uint32 maxTicks) {
+        if (replayMode == REPLAY_PLAYBACK) {
+            mode = static_cast<GameState>(replay.mode);
+            maxTicks = replay.tickCount();
+        }
+        world.state = mode;
+        resetGame();
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        Uint32 ticks = 0;
+        while (ticks < maxTicks && world.state != STATE_GAME_OVER) {
+            profiler.beginFrame();
+            {
+                ProfileScope scope(profiler, PHASE_UPDATE);
+                update();
+            }
+            profiler.endFrame();
+            ticks++;
+        }
+        double seconds = static_cast<double>(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+        std::cout << "ticks: " << ticks << std::endl;
+        std::cout << "seconds: " << seconds << std::endl;
+        std::cout << "ticks/s: " << (seconds > 0 ? ticks / seconds : 0) << std::endl;
+        std::cout << "wave: " << world.waveNumber << std::endl;
+        std::cout << "score: " << world.score << std::endl;
+        std::cout << "result: " << (world.state == STATE_GAME_OVER ? "game over" : "alive") << std::endl;
+        std::cout << "hash: " << stateHash() << std::endl;
+        finishRecording();
+    }
+
     void run() {
-        Uint32 frameStart;
-        int frameTime;
-        const int FPS = 60;
-        const int frameDelay = 1000 / FPS;
+        const Uint64 frequency = SDL_GetPerformanceFrequency();
+        const Uint64 tickLength = frequency / tickRate;
+        Uint64 previous = SDL_GetPerformanceCounter();
+        Uint64 accumulator = 0;
+        Uint64 nextFrame = previous;
+        bool idle = false;  // a static screen is on display and nothing has changed since
+
+        if (replayMode == REPLAY_PLAYBACK && world.state != STATE_LOADING) {
+            startGame(static_cast<GameState>(replay.mode));
+        }
 
         while (running) {
-            frameStart = SDL_GetTicks();
+            if (idle) {
+                SDL_WaitEventTimeout(nullptr, 500);
+                previous = nextFrame = SDL_GetPerformanceCounter();
+                accumulator = 0;
+            }
+            Uint64 now = SDL_GetPerformanceCounter();
+            accumulator += now - previous;
+            previous = now;
+            profiler.beginFrame();
+
+            GameState shownState = world.state;
+            bool changed;
+            {
+                ProfileScope scope(profiler, PHASE_EVENTS);
+                changed = handleEvents();
+                pollLoading();
+            }
+
+            {
+                ProfileScope scope(profiler, PHASE_UPDATE);
+                int ticks = 0;
+                while (accumulator >= tickLength && ticks < maxCatchUpTicks) {
+                    update();
+                    accumulator -= tickLength;
+                    ticks++;
+                }
+                if (accumulator >= tickLength) {
+                    accumulator %= tickLength;
+                }
+            }
+            sounds.dispatch();
+
+            if (idle && !changed && world.state == shownState) {
+                profiler.discardFrame();
+                continue;
+            }
+            render(static_cast<float>(accumulator) / tickLength);
+            profiler.endFrame();
+            idle = isStaticScreen();
+            if (!idle) paceFrame(nextFrame);
+        }
+        finishRecording();
+    }
+};
+
+// Sleeps off what is left of the current tick. A loop that fell far behind resynchronises instead of bursting.
+inline void waitForNextTick(Uint64& deadline, Uint64 tickLength) {
+    deadline += tickLength;
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now < deadline) {
+        SDL_Delay(static_cast<Uint32>((deadline - now) * 1000 / SDL_GetPerformanceFrequency()));
+    } else if (now - deadline > tickLength * 5) {
+        deadline = now;
+    }
+}
+
+// Authoritative server for one two-player match. The game runs headless; clients send inputs and get delta
+// snapshots at snapshotRate. More matches per box means more server processes on other ports.
+class NetServer {
+public:
+    static const size_t MAX_INPUT_LAG = 8;
+    static const int RESTART_DELAY_SECONDS = 3;
+
+    struct Client {
+        bool connected;
+        NetAddress address;
+        Uint32 lastHeard;
+        std::deque<Uint8> pendingInputs;
+        Uint32 queuedThrough;   // newest client input tick received
+        Uint32 appliedThrough;  // newest client input tick the simulation has consumed
+        Uint8 lastInput;
+        Uint32 ackedSnapshot;
+        Uint32 sentSequence[NET_SNAPSHOT_HISTORY];
+        std::vector<Uint8> sent[NET_SNAPSHOT_HISTORY];
+        Uint64 bytesSent;
+
+        void reset() {
+            connected = false;
+            lastHeard = 0;
+            pendingInputs.clear();
+            queuedThrough = appliedThrough = 0;
+            lastInput = 0;
+            ackedSnapshot = 0;
+            std::fill(sentSequence, sentSequence + NET_SNAPSHOT_HISTORY, 0u);
+            bytesSent = 0;
+        }
+    };
+
+    UdpSocket socket;
+    Client clients[MAX_PLAYERS];
+    int snapshotRate;
+    int ticksPerSnapshot;
+    Uint32 snapshotSequence;
+    int gameOverTicks;
+    NetSnapshot snapshot;
+    std::vector<Uint8> current;
+    std::vector<Uint8> packet;
+    Uint8 buffer[NET_MAX_PACKET];
+
+    explicit NetServer(int snapshotsPerSecond) : snapshotRate(std::max(1, snapshotsPerSecond)), ticksPerSnapshot(1),
+                                                 snapshotSequence(0), gameOverTicks(0) {
+        for (Client& client : clients) client.reset();
+    }
+
+    int connectedCount() const {
+        int count = 0;
+        for (const Client& client : clients) count += client.connected;
+        return count;
+    }
+
+    void beginPacket(NetMessage type) {
+        packet.clear();
+        NetWriter out(packet);
+        out.u16(NET_PROTOCOL);
+        out.u8(static_cast<Uint8>(type));
+    }
+
+    void receive(Game& game) {
+        NetAddress from;
+        int size;
+        while ((size = socket.receive(buffer, sizeof(buffer), from)) >= 0) {
+            NetReader in(buffer, size);
+            if (in.u16() != NET_PROTOCOL) continue;
+            Uint8 type = in.u8();
+            if (!in.ok) continue;
+
+            int index = -1;
+            for (int i = 0; i < MAX_PLAYERS; ++i) {
+                if (clients[i].connected && clients[i].address == from) index = i;
+            }
+
+            if (type == NET_HELLO) {
+                for (int i = 0; i < MAX_PLAYERS && index < 0; ++i) {
+                    if (clients[i].connected) continue;
+                    index = i;
+                    clients[i].reset();
+                    clients[i].connected = true;
+                    clients[i].address = from;
+                    std::cout << "Player " << i + 1 << " joined from " << from.toString() << std::endl;
+                    if (game.world.state != STATE_2P && game.world.state != STATE_GAME_OVER) {
+                        game.world.state = STATE_2P;
+                        game.resetGame();
+                    }
+                }
+                beginPacket(index < 0 ? NET_FULL : NET_WELCOME);
+                if (index >= 0) {
+                    NetWriter out(packet);
+                    out.u8(static_cast<Uint8>(index));
+                    out.u16(static_cast<Uint16>(game.tickRate));
+                    out.u16(static_cast<Uint16>(ticksPerSnapshot));
+                    clients[index].lastHeard = SDL_GetTicks();
+                }
+                socket.send(from, packet);
+            } else if (index < 0) {
+                continue;
+            } else if (type == NET_INPUT) {
+                receiveInput(clients[index], in);
+            } else if (type == NET_BYE) {
+                std::cout << "Player " << index + 1 << " left" << std::endl;
+                clients[index].reset();
+            }
+        }
+    }
+
+    // Each input packet repeats the client's last few inputs, so one lost datagram loses nothing. Inputs queue
+    // up and the simulation takes one per tick; a client that gets too far ahead has its oldest inputs dropped.
+    void receiveInput(Client& client, NetReader& in) {
+        Uint32 acked = in.u32();
+        Uint32 newest = in.u32();
+        Uint8 count = in.u8();
+        Uint8 inputs[NET_INPUT_REDUNDANCY];
+        if (count == 0 || count > NET_INPUT_REDUNDANCY || newest < count) return;
+        for (int i = 0; i < count; ++i) inputs[i] = in.u8();
+        if (!in.ok) return;
+
+        client.lastHeard = SDL_GetTicks();
+        client.ackedSnapshot = std::max(client.ackedSnapshot, acked);
+        Uint32 oldest = newest - count + 1;
+        if (newest > client.queuedThrough + 64) {
+            client.pendingInputs.clear();
+            client.queuedThrough = client.appliedThrough = oldest - 1;
+        }
+        for (Uint32 tick = client.queuedThrough + 1; tick <= newest; ++tick) {
+            Uint8 previous = client.pendingInputs.empty() ? client.lastInput : client.pendingInputs.back();
+            client.pendingInputs.push_back(tick >= oldest ? inputs[tick - oldest] : previous & ~INPUT_FIRE);
+        }
+        client.queuedThrough = std::max(client.queuedThrough, newest);
+        while (client.pendingInputs.size() > MAX_INPUT_LAG) {
+            client.pendingInputs.pop_front();
+            client.appliedThrough++;
+        }
+    }
+
+    void applyInput(PlayerTank& tank, Client& client) {
+        Uint8 bits = 0;
+        if (client.connected) {
+            if (!client.pendingInputs.empty()) {
+                bits = client.pendingInputs.front();
+                client.pendingInputs.pop_front();
+                client.appliedThrough++;
+                client.lastInput = bits;
+            } else {
+                bits = client.lastInput & ~INPUT_FIRE;
+            }
+        }
+        tank.setInput(bits);
+    }
+
+    void step(Game& game) {
+        if (game.world.state == STATE_GAME_OVER) {
+            if (++gameOverTicks >= RESTART_DELAY_SECONDS * game.tickRate) {
+                gameOverTicks = 0;
+                game.world.state = STATE_2P;
+                game.resetGame();
+            }
+            return;
+        }
+        for (int p = 0; p < MAX_PLAYERS; ++p) applyInput(game.world.players[p], clients[p]);
+        game.update();
+    }
+
+    static Uint8 directionOf(int dx, int dy) {
+        if (dx < 0) return 1;
+        if (dx > 0) return 3;
+        return dy < 0 ? 0 : 2;
+    }
+
+    void capture(Game& game) {
+        snapshot.state = static_cast<Uint8>(game.world.state);
+        snapshot.score = static_cast<Uint32>(game.world.score);
+        snapshot.wave = static_cast<Uint16>(game.world.waveNumber);
+        for (int p = 0; p < MAX_PLAYERS; ++p) {
+            const PlayerTank& tank = game.world.players[p];
+            snapshot.tanks[p] = {tank.rect.x, tank.rect.y, static_cast<Uint8>(tank.direction), tank.alive,
+                                 tank.invincible, tank.health};
+        }
+        snapshot.powerUpType = static_cast<Uint8>(game.world.powerUp.active ? game.world.powerUp.type : POWERUP_NONE);
+        snapshot.powerUpX = game.world.powerUp.rect.x;
+        snapshot.powerUpY = game.world.powerUp.rect.y;
+        memcpy(snapshot.map, game.world.map, sizeof(snapshot.map));
+        memcpy(snapshot.masks, game.world.collision.mask, sizeof(snapshot.masks));
+
+        snapshot.enemies.clear();
+        const EnemyPool& enemies = game.world.enemies;
+        for (int i = 0; i < enemies.count; ++i) {
+            if (!enemies.alive[i]) continue;
+            snapshot.enemies.push_back({enemies.slot[i], enemies.x[i], enemies.y[i],
+                                        enemies.direction[i], enemies.frozen[i]});
+        }
+        snapshot.bullets.clear();
+        BulletPool& bullets = game.world.bullets;
+        bullets.forEachActive([&](int i) {
+            snapshot.bullets.push_back({static_cast<Uint16>(i), bullets.x[i], bullets.y[i],
+                                        directionOf(bullets.dx[i], bullets.dy[i]), bullets.owner[i]});
+        });
+    }
+
+    // Each client gets the snapshot as a delta against the newest one it acknowledged, or in full when that
+    // one has aged out of the history.
+    void sendSnapshots(Game& game) {
+        capture(game);
+        snapshot.write(current);
+        snapshotSequence++;
+        int slot = snapshotSequence % NET_SNAPSHOT_HISTORY;
+        for (Client& client : clients) {
+            if (!client.connected) continue;
+            const std::vector<Uint8>* baseline = nullptr;
+            Uint32 baselineSequence = 0;
+            int ackSlot = client.ackedSnapshot % NET_SNAPSHOT_HISTORY;
+            if (client.ackedSnapshot != 0 && client.sentSequence[ackSlot] == client.ackedSnapshot) {
+                baseline = &client.sent[ackSlot];
+                baselineSequence = client.ackedSnapshot;
+            }
+            beginPacket(NET_SNAPSHOT);
+            NetWriter out(packet);
+            out.u32(snapshotSequence);
+            out.u32(baselineSequence);
+            out.u32(client.appliedThrough);
+            netDeltaEncode(current, baseline, out);
+            if (!socket.send(client.address, packet)) {
+                std::cerr << "Snapshot " << snapshotSequence << " (" << packet.size() << " bytes) to player "
+                          << &client - clients + 1 << " was not sent" << std::endl;
+                continue;
+            }
+            client.bytesSent += packet.size();
+            client.sent[slot] = current;
+            client.sentSequence[slot] = snapshotSequence;
+        }
+    }
+
+    void dropSilentClients() {
+        Uint32 now = SDL_GetTicks();
+        for (int i = 0; i < MAX_PLAYERS; ++i) {
+            Client& client = clients[i];
+            if (client.connected && now - client.lastHeard > NET_TIMEOUT_MS) {
+                std::cout << "Player " << i + 1 << " timed out" << std::endl;
+                client.reset();
+            }
+        }
+    }
+
+    // Runs until killed, or for maxTicks simulated ticks when that is non-zero. The match only advances while
+    // somebody is connected.
+    int run(Game& game, Uint16 port, Uint32 maxTicks) {
+        if (!socket.open(port)) {
+            std::cerr << "Failed to open UDP port " << port << std::endl;
+            return 1;
+        }
+        // A full snapshot carries the whole map and every entity and has to fit in one datagram, after the packet
+        // header and the three sequence numbers.
+        if (3 + 12 + netDeltaMaxBytes(NetSnapshot::MAX_BYTES) > size_t(NET_MAX_PACKET)) {
+            std::cerr << "A " << MAP_COLS << "x" << MAP_ROWS << " world is too large for network play" << std::endl;
+            return 1;
+        }
+        ticksPerSnapshot = std::max(1, game.tickRate / snapshotRate);
+        std::cout << "Server listening on UDP port " << port << ", " << game.tickRate << " ticks/s, snapshot every "
+                  << ticksPerSnapshot << " ticks" << std::endl;
+
+        const Uint64 frequency = SDL_GetPerformanceFrequency();
+        const Uint64 tickLength = frequency / game.tickRate;
+        Uint64 deadline = SDL_GetPerformanceCounter();
+        Uint32 ticks = 0;
+        Uint32 reportTicks = 0;
+        Uint64 busy = 0;
+        Uint64 reportBytes = 0;
+        Uint32 reportSnapshots = 0;
+        Uint32 lastReport = SDL_GetTicks();
+
+        while (game.running && (maxTicks == 0 || ticks < maxTicks)) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            receive(game);
+            dropSilentClients();
+            if (connectedCount() > 0) {
+                step(game);
+                ticks++;
+                reportTicks++;
+                if (ticks % ticksPerSnapshot == 0) {
+                    Uint64 before = 0;
+                    for (const Client& client : clients) before += client.bytesSent;
+                    sendSnapshots(game);
+                    for (const Client& client : clients) reportBytes += client.bytesSent;
+                    reportBytes -= before;
+                    reportSnapshots += connectedCount();
+                }
+            } else if (game.world.state != STATE_MENU) {
+                game.world.state = STATE_MENU;
+            }
+            busy += SDL_GetPerformanceCounter() - start;
+
+            if (SDL_GetTicks() - lastReport >= 10000) {
+                double seconds = (SDL_GetTicks() - lastReport) / 1000.0;
+                std::cout << "clients " << connectedCount() << ", tick "
+                          << (reportTicks ? busy * 1000.0 / frequency / reportTicks : 0) << " ms, snapshot "
+                          << (reportSnapshots ? reportBytes / reportSnapshots : 0) << " B, "
+                          << reportBytes / seconds / 1024 << " KiB/s out" << std::endl;
+                lastReport = SDL_GetTicks();
+                reportTicks = reportSnapshots = 0;
+                busy = reportBytes = 0;
+            }
+            waitForNextTick(deadline, tickLength);
+        }
+        return 0;
+    }
+};
+
+// Client for NetServer. The local tank is predicted: each tick its input runs locally at once, and every
+// snapshot rewinds it to the server's position and replays the inputs the server has not consumed yet.
+// Everything else is drawn between the two newest snapshots, one snapshot interval behind the server.
+class NetClient {
+public:
+    static const int INPUT_HISTORY = 256;
+    static const Uint32 HELLO_INTERVAL_MS = 500;
+
+    UdpSocket socket;
+    NetAddress server;
+    int localIndex;
+    int ticksPerSnapshot;
+    Uint32 connectStarted;
+    Uint32 lastHelloAt;
+    Uint32 lastHeard;
+    Uint32 inputTick;
+    Uint8 inputHistory[INPUT_HISTORY];
+    SDL_Point predicted[INPUT_HISTORY];
+    Uint32 receivedSequence[NET_SNAPSHOT_HISTORY];
+    std::vector<Uint8> received[NET_SNAPSHOT_HISTORY];
+    Uint32 latestSequence;
+    NetSnapshot previous, latest, incoming;
+    int snapshotCount;
+    Uint64 latestArrival;
+    std::vector<int> previousEnemy;
+    std::vector<int> previousBullet;
+    Random bot;
+    Uint64 bytesReceived;
+    Uint32 snapshotsReceived;
+    Uint32 mispredictions;
+    std::vector<Uint8> decoded;
+    std::vector<Uint8> packet;
+    Uint8 buffer[NET_MAX_PACKET];
+
+    NetClient() : localIndex(-1), ticksPerSnapshot(1), connectStarted(0), lastHelloAt(0), lastHeard(0), inputTick(0),
+                  latestSequence(0), snapshotCount(0), latestArrival(0), previousEnemy(MAX_ENEMIES, -1),
+                  previousBullet(MAX_BULLETS, -1), bot(1), bytesReceived(0), snapshotsReceived(0), mispredictions(0) {
+        std::fill(receivedSequence, receivedSequence + NET_SNAPSHOT_HISTORY, 0u);
+    }
+
+    bool connect(const std::string& address) {
+        if (!NetAddress::resolve(address, server)) {
+            std::cerr << "Cannot resolve server address: " << address << std::endl;
+            return false;
+        }
+        if (!socket.open(0)) {
+            std::cerr << "Failed to open UDP socket" << std::endl;
+            return false;
+        }
+        connectStarted = SDL_GetTicks();
+        sendMessage(NET_HELLO);
+        return true;
+    }
+
+    void sendMessage(NetMessage type) {
+        packet.clear();
+        NetWriter out(packet);
+        out.u16(NET_PROTOCOL);
+        out.u8(static_cast<Uint8>(type));
+        if (type == NET_HELLO) lastHelloAt = SDL_GetTicks();
+        if (type == NET_INPUT) {
+            Uint8 count = static_cast<Uint8>(std::min<Uint32>(inputTick, NET_INPUT_REDUNDANCY));
+            out.u32(latestSequence);
+            out.u32(inputTick);
+            out.u8(count);
+            for (Uint32 tick = inputTick - count + 1; tick <= inputTick; ++tick) out.u8(inputHistory[tick % INPUT_HISTORY]);
+        }
+        socket.send(server, packet);
+    }
+
+    // Picks a new heading every half second.
+    void driveBot(PlayerTank& tank, int tickRate) {
+        if (inputTick % std::max(1, tickRate / 2) == 0) {
+            int heading = bot.nextInt(5);
+            for (int k = 0; k < 4; ++k) tank.keys[k] = k == heading;
+        }
+        if (bot.nextInt(20) == 0) tank.fireRequested = true;
+    }
+
+    void predict(Game& game, PlayerTank& tank, Uint8 bits) {
+        tank.setInput(bits & ~INPUT_FIRE);
+        tank.update(game.world.collision, game.world.bullets, game.world.simTime, game.tickRate,
+                    &game.world.players[1 - localIndex].rect);
+    }
+
+    void tick(Game& game) {
+        if (localIndex < 0) {
+            if (SDL_GetTicks() - lastHelloAt >= HELLO_INTERVAL_MS) sendMessage(NET_HELLO);
+            receive(game);
+            return;
+        }
+        PlayerTank& tank = game.world.players[localIndex];
+        if (game.headless) driveBot(tank, game.tickRate);
+        Uint8 bits = tank.getInput();
+        inputTick++;
+        inputHistory[inputTick % INPUT_HISTORY] = bits;
+        sendMessage(NET_INPUT);
+        receive(game);
+        if (snapshotCount > 0) predict(game, tank, bits);
+        predicted[inputTick % INPUT_HISTORY] = {tank.rect.x, tank.rect.y};
+    }
+
+    void receive(Game& game) {
+        NetAddress from;
+        int size;
+        while ((size = socket.receive(buffer, sizeof(buffer), from)) >= 0) {
+            if (!(from == server)) continue;
+            NetReader in(buffer, size);
+            if (in.u16() != NET_PROTOCOL) continue;
+            Uint8 type = in.u8();
+            if (!in.ok) continue;
+            lastHeard = SDL_GetTicks();
+
+            if (type == NET_WELCOME && localIndex < 0) {
+                int index = in.u8();
+                int tickRate = in.u16();
+                int snapshotTicks = in.u16();
+                if (!in.ok || index >= MAX_PLAYERS) continue;
+                if (!Game::validTickRate(tickRate)) {
+                    std::cerr << "Server runs at an unsupported " << tickRate << " ticks/s" << std::endl;
+                    game.running = false;
+                    return;
+                }
+                localIndex = index;
+                game.localPlayer = index;
+                game.setTickRate(tickRate);
+                ticksPerSnapshot = std::max(1, snapshotTicks);
+                std::cout << "Joined " << server.toString() << " as player " << index + 1 << std::endl;
+            } else if (type == NET_FULL) {
+                std::cerr << "Server is full" << std::endl;
+                game.running = false;
+            } else if (type == NET_SNAPSHOT && localIndex >= 0) {
+                Uint32 sequence = in.u32();
+                Uint32 baseline = in.u32();
+                Uint32 inputAck = in.u32();
+                if (!in.ok || sequence <= latestSequence) continue;
+                const std::vector<Uint8>* base = nullptr;
+                if (baseline != 0) {
+                    int slot = baseline % NET_SNAPSHOT_HISTORY;
+                    if (receivedSequence[slot] != baseline) continue;
+                    base = &received[slot];
+                }
+                if (!netDeltaDecode(in, base, decoded) || !incoming.read(decoded)) continue;
+
+                int slot = sequence % NET_SNAPSHOT_HISTORY;
+                received[slot].swap(decoded);
+                receivedSequence[slot] = sequence;
+                latestSequence = sequence;
+                std::swap(previous, latest);
+                std::swap(latest, incoming);
+                snapshotCount++;
+                latestArrival = SDL_GetPerformanceCounter();
+                bytesReceived += size;
+                snapshotsReceived++;
+                applySnapshot(game, inputAck);
+            }
+        }
+    }
+
+    void applySnapshot(Game& game, Uint32 inputAck) {
+        GameState serverState = static_cast<GameState>(latest.state);
+        if (game.world.state != STATE_LOADING && game.world.state != serverState) {
+            game.world.state = serverState;
+            if (serverState == STATE_2P) Mix_ResumeMusic();
+        }
+        game.world.score = static_cast<int>(latest.score);
+        game.world.waveNumber = latest.wave;
+        for (int row = 0; row < MAP_ROWS; ++row) {
+            for (int col = 0; col < MAP_COLS; ++col) {
+                if (game.world.map[row][col] == latest.map[row][col] &&
+                    game.world.collision.mask[row][col] == latest.masks[row][col]) {
+                    continue;
+                }
+                game.world.map[row][col] = latest.map[row][col];
+                game.world.collision.mask[row][col] = latest.masks[row][col];
+                game.terrain.markDirty(row, col);
+            }
+        }
+        game.world.hasPlayer[0] = true;
+        game.world.hasPlayer[1] = true;
+        for (int p = 0; p < MAX_PLAYERS; ++p) {
+            PlayerTank& tank = game.world.players[p];
+            const NetTank& remote = latest.tanks[p];
+            tank.owner = p == 0 ? OWNER_PLAYER1 : OWNER_PLAYER2;
+            tank.alive = remote.alive;
+            tank.invincible = remote.invincible;
+            tank.health = remote.health;
+            if (p != localIndex) tank.direction = remote.direction;
+        }
+        reconcile(game, inputAck);
+
+        game.world.powerUp.active = latest.powerUpType != POWERUP_NONE;
+        game.world.powerUp.type = static_cast<PowerUpType>(latest.powerUpType);
+        game.world.powerUp.rect.x = latest.powerUpX;
+        game.world.powerUp.rect.y = latest.powerUpY;
+
+        std::fill(previousEnemy.begin(), previousEnemy.end(), -1);
+        std::fill(previousBullet.begin(), previousBullet.end(), -1);
+        if (snapshotCount > 1) {
+            for (size_t i = 0; i < previous.enemies.size(); ++i) previousEnemy[previous.enemies[i].id] = static_cast<int>(i);
+            for (size_t i = 0; i < previous.bullets.size(); ++i) previousBullet[previous.bullets[i].id] = static_cast<int>(i);
+            queueSounds(game);
+        }
+    }
+
+    // The server's sound requests are not sent, so bullets new since the last snapshot count as shots and
+    // enemies gone from it as explosions.
+    void queueSounds(Game& game) {
+        for (const NetEntity& bullet : latest.bullets) {
+            if (previousBullet[bullet.id] >= 0) continue;
+            game.sounds.play(SOUND_SHOOT);
+            break;
+        }
+        size_t survivors = 0;
+        for (const NetEntity& enemy : latest.enemies) {
+            if (previousEnemy[enemy.id] >= 0) survivors++;
+        }
+        if (survivors < previous.enemies.size()) game.sounds.play(SOUND_EXPLOSION);
+    }
+
+    void reconcile(Game& game, Uint32 inputAck) {
+        PlayerTank& tank = game.world.players[localIndex];
+        const NetTank& state = latest.tanks[localIndex];
+        bool replayable = inputTick - inputAck < INPUT_HISTORY;
+        if (inputAck > 0 && replayable) {
+            const SDL_Point& guess = predicted[inputAck % INPUT_HISTORY];
+            if (guess.x != state.x || guess.y != state.y) mispredictions++;
+        }
+
+        int prevX = tank.prevX;
+        int prevY = tank.prevY;
+        tank.x = static_cast<float>(state.x);
+        tank.y = static_cast<float>(state.y);
+        tank.rect.x = state.x;
+        tank.rect.y = state.y;
+        tank.direction = state.direction;
+        if (snapshotCount == 1) {
+            prevX = state.x;
+            prevY = state.y;
+        }
+        if (replayable) {
+            // The current tick's input is applied after this, so replay stops one short of it.
+            for (Uint32 tick = inputAck + 1; tick < inputTick; ++tick) {
+                predict(game, tank, inputHistory[tick % INPUT_HISTORY]);
+                predicted[tick % INPUT_HISTORY] = {tank.rect.x, tank.rect.y};
+            }
+        }
+        tank.prevX = prevX;
+        tank.prevY = prevY;
+    }
+
+    // Positions between the two newest snapshots go straight into the pools, so render() needs no alpha for
+    // them. Jumps of more than two tiles (respawns, new levels, reused ids) snap instead of sliding.
+    void present(Game& game) {
+        if (snapshotCount == 0) return;
+        float t = 1.0f;
+        if (snapshotCount > 1) {
+            double interval = static_cast<double>(ticksPerSnapshot) / game.tickRate;
+            double elapsed = static_cast<double>(SDL_GetPerformanceCounter() - latestArrival) / SDL_GetPerformanceFrequency();
+            t = static_cast<float>(std::min(1.0, elapsed / interval));
+        }
+        auto blend = [t](int from, int to) {
+            return std::abs(to - from) > GRID_SIZE * 2 ? to : lerpInt(from, to, t);
+        };
+
+        if (snapshotCount > 1) {
+            int other = 1 - localIndex;
+            PlayerTank& tank = game.world.players[other];
+            tank.rect.x = tank.prevX = blend(previous.tanks[other].x, latest.tanks[other].x);
+            tank.rect.y = tank.prevY = blend(previous.tanks[other].y, latest.tanks[other].y);
+            tank.x = static_cast<float>(tank.rect.x);
+            tank.y = static_cast<float>(tank.rect.y);
+        } else {
+            for (int p = 0; p < MAX_PLAYERS; ++p) {
+                if (p == localIndex) continue;
+                PlayerTank& tank = game.world.players[p];
+                tank.rect.x = tank.prevX = latest.tanks[p].x;
+                tank.rect.y = tank.prevY = latest.tanks[p].y;
+            }
+        }
 
-            handleEvents();
-            update();
-            render();
+        EnemyPool& enemies = game.world.enemies;
+        enemies.count = static_cast<int>(latest.enemies.size());
+        for (int i = 0; i < enemies.count; ++i) {
+            const NetEntity& enemy = latest.enemies[i];
+            int p = previousEnemy[enemy.id];
+            const NetEntity& from = p >= 0 ? previous.enemies[p] : enemy;
+            enemies.x[i] = enemies.prevX[i] = blend(from.x, enemy.x);
+            enemies.y[i] = enemies.prevY[i] = blend(from.y, enemy.y);
+            enemies.direction[i] = enemy.direction;
+            enemies.frozen[i] = enemy.extra;
+            enemies.alive[i] = 1;
+        }
+
+        game.world.bullets.clear();
+        for (const NetEntity& bullet : latest.bullets) {
+            int p = previousBullet[bullet.id];
+            const NetEntity& from = p >= 0 ? previous.bullets[p] : bullet;
+            game.world.bullets.spawn(blend(from.x, bullet.x), blend(from.y, bullet.y), bullet.direction,
+                               static_cast<BulletOwner>(bullet.extra));
+        }
+    }
 
-            frameTime = SDL_GetTicks() - frameStart;
-            if (frameDelay > frameTime) {
-                SDL_Delay(frameDelay - frameTime);
+    bool timedOut() const {
+        Uint32 now = SDL_GetTicks();
+        if (localIndex < 0) return now - connectStarted > NET_TIMEOUT_MS;
+        return now - lastHeard > NET_TIMEOUT_MS;
+    }
+
+    // Headless clients drive their tank with a random bot for maxTicks ticks, which is how the netcode is
+    // exercised over loopback; windowed clients play until the window closes.
+    int run(Game& game, Uint32 maxTicks) {
+        const Uint64 frequency = SDL_GetPerformanceFrequency();
+        Uint64 previousFrame = SDL_GetPerformanceCounter();
+        Uint64 accumulator = 0;
+        Uint64 deadline = previousFrame;
+        Uint64 frameMark = previousFrame;
+        bot.seed(game.world.seed);
+
+        Uint32 ticks = 0;
+        int result = 0;
+        while (game.running && (maxTicks == 0 || ticks < maxTicks)) {
+            Uint64 tickLength = frequency / game.tickRate;
+            if (game.headless) {
+                tick(game);
+                ticks++;
+                waitForNextTick(deadline, tickLength);
+            } else {
+                Uint64 now = SDL_GetPerformanceCounter();
+                accumulator += now - previousFrame;
+                previousFrame = now;
+                game.profiler.beginFrame();
+                {
+                    ProfileScope scope(game.profiler, PHASE_EVENTS);
+                    game.handleEvents();
+                    game.pollLoading();
+                }
+                {
+                    ProfileScope scope(game.profiler, PHASE_UPDATE);
+                    int steps = 0;
+                    while (accumulator >= tickLength && steps < game.maxCatchUpTicks) {
+                        tick(game);
+                        accumulator -= tickLength;
+                        steps++;
+                        ticks++;
+                    }
+                    if (accumulator >= tickLength) accumulator %= tickLength;
+                }
+                present(game);
+                game.sounds.dispatch();
+                game.render(static_cast<float>(accumulator) / tickLength);
+                game.profiler.endFrame();
+                game.paceFrame(frameMark);
+            }
+            if (timedOut()) {
+                std::cerr << (localIndex < 0 ? "No answer from " : "Lost connection to ") << server.toString() << std::endl;
+                result = 1;
+                break;
             }
         }
+        if (localIndex >= 0) sendMessage(NET_BYE);
+
+        if (game.headless) {
+            double seconds = static_cast<double>(ticks) / game.tickRate;
+            std::cout << "ticks: " << ticks << std::endl;
+            std::cout << "snapshots: " << snapshotsReceived << std::endl;
+            std::cout << "bytes/snapshot: " << (snapshotsReceived ? bytesReceived / snapshotsReceived : 0) << std::endl;
+            std::cout << "KiB/s in: " << (seconds > 0 ? bytesReceived / seconds / 1024 : 0) << std::endl;
+            std::cout << "mispredicted snapshots: " << mispredictions << std::endl;
+            std::cout << "wave: " << game.world.waveNumber << std::endl;
+            std::cout << "score: " << game.world.score << std::endl;
+        }
+        return result;
     }
 };
 
+#ifndef BATTLECITY_NO_MAIN
 int main(int argc, char* argv[]) {
-    Game game;
-    game.run();
+    bool headless = false;
+    bool twoPlayers = false;
+    int tickRate = DEFAULT_TICK_RATE;
+    Uint32 seed = static_cast<Uint32>(time(0));
+    int maxEnemies = 10;
+    int threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* profileCsvPath = nullptr;
+    const char* exportLevelPath = nullptr;
+    const char* connectAddress = nullptr;
+    int serverPort = -1;
+    int snapshotRate = 20;
+    int rewindSeconds = 0;  // debug rewind is opt-in, as it snapshots every tick
+    const char* archivePath = "battlecity.bcpk";
+    FramePacing pacing = PACING_VSYNC;
+    int frameRate = 0;
+    std::vector<std::string> levelPaths;
+    Uint32 maxTicks = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--2p") == 0) {
+            twoPlayers = true;
+        } else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+            maxTicks = static_cast<Uint32>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            tickRate = atoi(argv[++i]);
+            if (!Game::validTickRate(tickRate)) {
+                std::cerr << "Tick rate must be between " << MIN_TICK_RATE << " and " << MAX_TICK_RATE << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--max-enemies") == 0 && i + 1 < argc) {
+            maxEnemies = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = static_cast<Uint32>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) {
+            profileCsvPath = argv[++i];
+        } else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            levelPaths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--export-level") == 0 && i + 1 < argc) {
+            exportLevelPath = argv[++i];
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            serverPort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connectAddress = argv[++i];
+        } else if (strcmp(argv[i], "--snapshot-rate") == 0 && i + 1 < argc) {
+            snapshotRate = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--rewind-seconds") == 0 && i + 1 < argc) {
+            rewindSeconds = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            archivePath = argv[++i];
+        } else if (strcmp(argv[i], "--pacing") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "vsync") == 0) {
+                pacing = PACING_VSYNC;
+            } else if (strcmp(mode, "timer") == 0) {
+                pacing = PACING_TIMER;
+            } else if (strcmp(mode, "uncapped") == 0) {
+                pacing = PACING_UNCAPPED;
+            } else {
+                std::cerr << "Unknown pacing mode " << mode << "; use vsync, timer or uncapped" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            frameRate = std::max(1, atoi(argv[++i]));
+        }
+    }
+
+    if (exportLevelPath) {
+        std::unique_ptr<Game> exporter(new Game(true));
+        exporter->exportBuiltinLevel(exportLevelPath);
+        return 0;
+    }
+
+    if (serverPort >= 0) headless = true;
+    // Game holds the whole map inline, which outgrows the stack for large worlds.
+    std::unique_ptr<Game> game(new Game(headless, tickRate, seed, archivePath));
+    for (const std::string& path : levelPaths) {
+        if (!game->addLevel(path)) return 1;
+    }
+    game->setMaxEnemiesPerWave(maxEnemies);
+    game->setWorkerThreads(threads);
+    if (profileCsvPath) game->setProfileCsv(profileCsvPath);
+    if (replayPath) {
+        if (!game->startPlayback(replayPath)) return 1;
+    } else if (recordPath) {
+        game->startRecording(recordPath);
+    }
+    game->setRewindSeconds(rewindSeconds);
+    game->setPacing(pacing, frameRate);
+
+    if (serverPort >= 0) {
+        std::unique_ptr<NetServer> server(new NetServer(snapshotRate));
+        return server->run(*game, static_cast<Uint16>(serverPort), maxTicks);
+    } else if (connectAddress) {
+        std::unique_ptr<NetClient> client(new NetClient());
+        if (!client->connect(connectAddress)) return 1;
+        return client->run(*game, headless ? (maxTicks ? maxTicks : tickRate * 60) : 0);
+    } else if (headless) {
+        game->runHeadless(twoPlayers ? STATE_2P : STATE_1P, maxTicks ? maxTicks : tickRate * 60 * 5);
+    } else {
+        game->run();
+    }
     return 0;
 }
+#endif
@@ -0,0 +1,234 @@
+// Simulation benchmarks. Builds synthetic worlds without a window and times the hot paths of battlecity.cpp.
+// Build: g++ -O2 -std=c++17 bench.cpp -o bench $(sdl2-config --cflags --libs) -lSDL2_image -lSDL2_ttf -lSDL2_mixer
+// Output: one JSON object per line and target, e.g. ./bench --reps 7 --filter 2p_dense > results.jsonl
+#define BATTLECITY_NO_MAIN
+#include "battlecity.cpp"
+
+enum WallLayout {
+    WALLS_NONE,
+    WALLS_SPARSE,
+    WALLS_DENSE
+};
+
+enum BenchTarget {
+    TARGET_TICK,
+    TARGET_ENEMIES,
+    TARGET_BULLETS,
+    TARGET_COLLISION,
+    TARGET_COUNT
+};
+
+static const char* const TARGET_NAMES[TARGET_COUNT] = {"tick", "enemies", "bullets", "collision"};
+static const char* const LAYOUT_NAMES[] = {"none", "sparse", "dense"};
+
+struct Scenario {
+    GameState mode;
+    WallLayout walls;
+    int enemies;
+    int bullets;
+};
+
+struct BenchResult {
+    double ticksPerSecond;
+    double nsPerEntity;
+    double meanEnemies;  // present at the start of a measured tick
+    double meanBullets;
+    double minSeconds;
+    double medianSeconds;
+    double maxSeconds;
+};
+
+class Benchmark {
+public:
+    int warmupTicks;
+    int measuredTicks;
+    int repetitions;
+    int threads;
+    Uint32 seed;
+
+    Benchmark() : warmupTicks(120), measuredTicks(600), repetitions(5), threads(1), seed(12345) {}
+
+    static void buildWalls(Game& game, WallLayout walls, Random& rng) {
+        int percent = walls == WALLS_DENSE ? 35 : walls == WALLS_SPARSE ? 8 : 0;
+        for (int row = 0; row < MAP_ROWS; ++row) {
+            for (int col = 0; col < MAP_COLS; ++col) {
+                int roll = rng.nextInt(100);
+                game.world.map[row][col] = roll < percent ? (roll % 3 == 0 ? 1 : 2) : 0;
+            }
+        }
+        // Keep both player spawn tiles open.
+        game.world.map[MAP_ROWS - 2][1] = 0;
+        game.world.map[MAP_ROWS - 2][MAP_COLS - 2] = 0;
+        game.rebuildMapCaches();
+    }
+
+    static void spawnBullet(Game& game, Random& rng) {
+        int x = rng.nextInt(WORLD_WIDTH - BULLET_SIZE);
+        int y = rng.nextInt(WORLD_HEIGHT - BULLET_SIZE);
+        int roll = rng.nextInt(4);
+        BulletOwner owner = roll < 2 ? OWNER_ENEMY : (roll == 3 && game.player2() ? OWNER_PLAYER2 : OWNER_PLAYER1);
+        game.world.bullets.spawn(x, y, rng.nextInt(4), owner);
+    }
+
+    // Enemies may share tiles; the point is the entity count, not a playable layout.
+    static void spawnEnemy(Game& game, Random& rng) {
+        int x = 0, y = 0;
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            x = rng.nextInt(MAP_COLS) * GRID_SIZE;
+            y = rng.nextInt(MAP_ROWS) * GRID_SIZE;
+            SDL_Rect rect = {x, y, GRID_SIZE, GRID_SIZE};
+            if (!game.world.collision.overlapsSolid(rect)) break;
+        }
+        game.world.enemies.spawn(x, y, game.player2() ? game.world.enemies.count % 2 : 0, game.world.rng);
+    }
+
+    void setup(Game& game, const Scenario& scenario, Random& rng) {
+        game.world.seed = seed;
+        game.world.state = scenario.mode;
+        game.resetGame();
+        buildWalls(game, scenario.walls, rng);
+
+        for (PlayerTank& player : game.world.players) {
+            player.invincible = true;
+            player.invincibleEndTime = 0xFFFFFFFFu;
+        }
+        game.world.enemies.clear();
+        topUp(game, scenario, rng);
+    }
+
+    // Player bullets kill enemies and a cleared wave starts a small new one, so both populations are refilled
+    // before every tick to keep the world at the scenario's size.
+    static void topUp(Game& game, const Scenario& scenario, Random& rng) {
+        while (game.world.enemies.count < scenario.enemies && game.world.enemies.count < MAX_ENEMIES) {
+            spawnEnemy(game, rng);
+        }
+        while (game.world.bullets.activeCount < scenario.bullets && game.world.bullets.activeCount < MAX_BULLETS) {
+            spawnBullet(game, rng);
+        }
+    }
+
+    static void step(Game& game, BenchTarget target) {
+        switch (target) {
+            case TARGET_TICK:
+                game.update();
+                break;
+            case TARGET_ENEMIES:
+                game.updateFlowFields();
+                game.world.enemies.update(game.world.collision, game.world.players, game.flowFields, game.world.bullets,
+                                          game.enemyCommands, game.world.simTicks, game.world.simTime, &game.workers);
+                break;
+            case TARGET_BULLETS:
+                game.updateBullets();
+                break;
+            case TARGET_COLLISION:
+                game.checkBulletHits();
+                game.world.enemies.removeDead();
+                break;
+            default:
+                break;
+        }
+    }
+
+    BenchResult run(const Scenario& scenario, BenchTarget target) {
+        std::unique_ptr<Game> game(new Game(true, DEFAULT_TICK_RATE, seed));
+        game->setWorkerThreads(threads);
+        game->setMaxEnemiesPerWave(MAX_ENEMIES);
+        // A bomb would clear the population and a freeze would stop enemy updates mid-measurement.
+        GameTuning tuning;
+        tuning.powerUpSpawnInterval = 0xFFFFFFFFu;
+        game->setTuning(tuning);
+
+        std::vector<double> samples;
+        Uint64 enemyTicks = 0, bulletTicks = 0;
+        Uint64 frequency = SDL_GetPerformanceFrequency();
+        for (int rep = 0; rep < repetitions; ++rep) {
+            Random rng(seed);
+            setup(*game, scenario, rng);
+            for (int t = 0; t < warmupTicks; ++t) {
+                topUp(*game, scenario, rng);
+                step(*game, target);
+            }
+
+            Uint64 elapsed = 0;
+            for (int t = 0; t < measuredTicks; ++t) {
+                topUp(*game, scenario, rng);
+                enemyTicks += game->world.enemies.count;
+                bulletTicks += game->world.bullets.activeCount;
+                Uint64 start = SDL_GetPerformanceCounter();
+                step(*game, target);
+                elapsed += SDL_GetPerformanceCounter() - start;
+            }
+            samples.push_back(static_cast<double>(elapsed) / frequency);
+        }
+
+        std::sort(samples.begin(), samples.end());
+        BenchResult result;
+        result.minSeconds = samples.front();
+        result.maxSeconds = samples.back();
+        result.medianSeconds = samples[samples.size() / 2];
+        result.ticksPerSecond = result.medianSeconds > 0 ? measuredTicks / result.medianSeconds : 0;
+        double measured = static_cast<double>(measuredTicks) * repetitions;
+        result.meanEnemies = enemyTicks / measured;
+        result.meanBullets = bulletTicks / measured;
+        double entities = std::max(1.0, result.meanEnemies + result.meanBullets + (scenario.mode == STATE_2P ? 2 : 1));
+        result.nsPerEntity = result.medianSeconds * 1e9 / measuredTicks / entities;
+        return result;
+    }
+
+    static std::string nameOf(const Scenario& scenario) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s_%s_e%d_b%d", scenario.mode == STATE_2P ? "2p" : "1p",
+                 LAYOUT_NAMES[scenario.walls], scenario.enemies, scenario.bullets);
+        return name;
+    }
+
+    void report(const Scenario& scenario, BenchTarget target, const BenchResult& result) const {
+        printf("{\"scenario\":\"%s\",\"target\":\"%s\",\"players\":%d,\"walls\":\"%s\",\"enemies\":%d,"
+               "\"bullets\":%d,\"mean_enemies\":%.1f,\"mean_bullets\":%.1f,\"threads\":%d,\"warmup_ticks\":%d,"
+               "\"ticks\":%d,\"repetitions\":%d,\"ticks_per_second\":%.1f,\"ns_per_entity\":%.2f,\"min_s\":%.6f,"
+               "\"median_s\":%.6f,\"max_s\":%.6f}\n",
+               nameOf(scenario).c_str(), TARGET_NAMES[target], scenario.mode == STATE_2P ? 2 : 1,
+               LAYOUT_NAMES[scenario.walls], scenario.enemies, scenario.bullets, result.meanEnemies,
+               result.meanBullets, threads, warmupTicks, measuredTicks, repetitions, result.ticksPerSecond,
+               result.nsPerEntity, result.minSeconds, result.medianSeconds, result.maxSeconds);
+        fflush(stdout);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    Benchmark bench;
+    const char* filter = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            bench.warmupTicks = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+            bench.measuredTicks = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            bench.repetitions = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            bench.threads = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            bench.seed = static_cast<Uint32>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        }
+    }
+
+    static const GameState modes[] = {STATE_1P, STATE_2P};
+    static const WallLayout layouts[] = {WALLS_NONE, WALLS_SPARSE, WALLS_DENSE};
+    static const int populations[][2] = {{10, 50}, {200, 500}, {1000, 4000}};
+
+    for (GameState mode : modes) {
+        for (WallLayout walls : layouts) {
+            for (const int* population : populations) {
+                Scenario scenario = {mode, walls, population[0], population[1]};
+                if (filter && Benchmark::nameOf(scenario).find(filter) == std::string::npos) continue;
+                for (int target = 0; target < TARGET_COUNT; ++target) {
+                    BenchTarget benchTarget = static_cast<BenchTarget>(target);
+                    bench.report(scenario, benchTarget, bench.run(scenario, benchTarget));
+                }
+            }
+        }
+    }
+    return 0;
+}
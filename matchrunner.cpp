@@ -0,0 +1,331 @@
+// Batch match runner for difficulty tuning. Plays many headless games with scripted bots on every core and
+// prints survival time, wave and score distributions for each combination of tuning values.
+// Build: g++ -O2 -std=c++17 matchrunner.cpp -o matchrunner $(sdl2-config --cflags --libs) -lSDL2_image -lSDL2_ttf -lSDL2_mixer -pthread
+// Usage: ./matchrunner --matches 20000 --move-duration 667,833,1000 --shoot-cooldown 750,1000 > sweep.jsonl
+// --bot hunter|wander picks the bots and --tick-rate the simulation rate; timings stay in milliseconds.
+// Tuning flags take comma-separated lists and every combination is run with the same seeds.
+#define BATTLECITY_NO_MAIN
+#include "battlecity.cpp"
+
+enum BotStyle {
+    BOT_HUNTER,
+    BOT_WANDER
+};
+
+static const char* const BOT_NAMES[] = {"hunter", "wander"};
+
+// Drives one tank from the same state a player sees. Hunters line up with the nearest enemy (or a closer
+// power-up) on the shorter axis and fire along the longer one; wanderers pick a random heading every half
+// second. Both shoot at most every quarter second and turn randomly when blocked. Timings are set in
+// milliseconds, so bots play the same at every tick rate.
+class ScriptedBot {
+public:
+    BotStyle style;
+    Random rng;
+    int heading;
+    int holdTicks;
+    int fireWait;
+    int fireInterval;
+    int wanderTicks;
+    int detourTicks;  // a blocked bot keeps its new heading for detourTicks to twice that
+    float lastX, lastY;
+
+    ScriptedBot() : style(BOT_HUNTER), heading(-1), holdTicks(0), fireWait(0), fireInterval(15), wanderTicks(30),
+                    detourTicks(20), lastX(-1), lastY(-1) {}
+
+    void reset(BotStyle botStyle, Uint32 seed, int tickRate) {
+        style = botStyle;
+        rng.seed(seed);
+        heading = -1;
+        holdTicks = 0;
+        fireWait = 0;
+        fireInterval = ticksFor(250, tickRate);
+        wanderTicks = ticksFor(500, tickRate);
+        detourTicks = std::max(1, ticksFor(333, tickRate));
+        lastX = lastY = -1;
+    }
+
+    static int headingTowards(int dx, int dy, bool alongX) {
+        if (alongX) return dx < 0 ? 1 : 3;
+        return dy < 0 ? 0 : 2;
+    }
+
+    void drive(PlayerTank& tank, const EnemyPool& enemies, const PowerUp& powerUp) {
+        // Compared unrounded: at high tick rates a step can be under a pixel.
+        bool stuck = heading >= 0 && tank.x == lastX && tank.y == lastY;
+        lastX = tank.x;
+        lastY = tank.y;
+        if (fireWait > 0) fireWait--;
+
+        bool fire = false;
+        if (holdTicks > 0) {
+            holdTicks--;
+            fire = stuck;
+        } else if (stuck) {
+            // Blocked: try another way for a moment and shoot whatever is in front.
+            heading = rng.nextInt(4);
+            holdTicks = detourTicks + rng.nextInt(detourTicks);
+            fire = true;
+        } else if (style == BOT_WANDER) {
+            heading = rng.nextInt(5) - 1;
+            holdTicks = wanderTicks;
+            fire = rng.nextInt(4) == 0;
+        } else {
+            int centerX = tank.rect.x + PlayerTank::width / 2, centerY = tank.rect.y + PlayerTank::height / 2;
+            int targetX = 0, targetY = 0, best = -1;
+            for (int i = 0; i < enemies.count; ++i) {
+                if (!enemies.alive[i]) continue;
+                int ex = enemies.x[i] + GRID_SIZE / 2, ey = enemies.y[i] + GRID_SIZE / 2;
+                int distance = std::abs(ex - centerX) + std::abs(ey - centerY);
+                if (best < 0 || distance < best) {
+                    best = distance;
+                    targetX = ex;
+                    targetY = ey;
+                }
+            }
+            bool chasingPowerUp = false;
+            if (powerUp.active) {
+                int px = powerUp.rect.x + GRID_SIZE / 2, py = powerUp.rect.y + GRID_SIZE / 2;
+                int distance = std::abs(px - centerX) + std::abs(py - centerY);
+                if (best < 0 || distance < best) {
+                    best = distance;
+                    targetX = px;
+                    targetY = py;
+                    chasingPowerUp = true;
+                }
+            }
+
+            if (best < 0) {
+                heading = -1;
+            } else {
+                int dx = targetX - centerX, dy = targetY - centerY;
+                const int aligned = GRID_SIZE / 4;
+                if (!chasingPowerUp && std::abs(dx) <= aligned) {
+                    heading = headingTowards(dx, dy, false);
+                    fire = true;
+                } else if (!chasingPowerUp && std::abs(dy) <= aligned) {
+                    heading = headingTowards(dx, dy, true);
+                    fire = true;
+                } else {
+                    // Close the smaller gap first so the target ends up in a straight line.
+                    bool alongX = chasingPowerUp ? std::abs(dx) >= std::abs(dy) : std::abs(dx) < std::abs(dy);
+                    heading = headingTowards(dx, dy, alongX);
+                }
+            }
+        }
+
+        for (int k = 0; k < 4; ++k) tank.keys[k] = k == heading;
+        if (fire && fireWait == 0) {
+            tank.fireRequested = true;
+            fireWait = fireInterval;
+        }
+    }
+};
+
+struct MatchResult {
+    Uint32 ticks;
+    int wave;
+    int score;
+    bool survived;  // still alive when the tick limit hit
+};
+
+struct Distribution {
+    double mean;
+    double p10, p50, p90;
+    double min, max;
+
+    static Distribution of(std::vector<double> values) {
+        Distribution d = {0, 0, 0, 0, 0, 0};
+        if (values.empty()) return d;
+        std::sort(values.begin(), values.end());
+        for (double v : values) d.mean += v;
+        d.mean /= values.size();
+        d.min = values.front();
+        d.max = values.back();
+        d.p10 = values[(values.size() - 1) * 10 / 100];
+        d.p50 = values[(values.size() - 1) * 50 / 100];
+        d.p90 = values[(values.size() - 1) * 90 / 100];
+        return d;
+    }
+
+    std::string json() const {
+        char text[192];
+        snprintf(text, sizeof(text), "{\"mean\":%.2f,\"min\":%.2f,\"p10\":%.2f,\"p50\":%.2f,\"p90\":%.2f,\"max\":%.2f}",
+                 mean, min, p10, p50, p90, max);
+        return text;
+    }
+};
+
+class MatchRunner {
+public:
+    int matches;
+    int threads;
+    int players;
+    int tickRate;
+    Uint32 maxTicks;
+    Uint32 firstSeed;
+    int maxEnemies;
+    BotStyle style;
+    GameTuning tuning;
+    std::vector<MatchResult> results;
+
+    MatchRunner() : matches(1000), threads(std::max(1, static_cast<int>(std::thread::hardware_concurrency()))),
+                    players(1), tickRate(DEFAULT_TICK_RATE), maxTicks(DEFAULT_TICK_RATE * 60 * 10), firstSeed(1),
+                    maxEnemies(10), style(BOT_HUNTER) {}
+
+    MatchResult play(Game& game, ScriptedBot bots[MAX_PLAYERS], Uint32 seed) {
+        game.world.seed = seed;
+        game.world.state = players == 2 ? STATE_2P : STATE_1P;
+        game.resetGame();
+        for (int p = 0; p < MAX_PLAYERS; ++p) bots[p].reset(style, seed * 2 + p, tickRate);
+
+        Uint32 ticks = 0;
+        while (ticks < maxTicks && game.world.state != STATE_GAME_OVER) {
+            for (int p = 0; p < players; ++p) {
+                PlayerTank& tank = game.world.players[p];
+                if (tank.alive) bots[p].drive(tank, game.world.enemies, game.world.powerUp);
+            }
+            game.update();
+            ticks++;
+        }
+        MatchResult result = {ticks, game.world.waveNumber, game.world.score, game.world.state != STATE_GAME_OVER};
+        return result;
+    }
+
+    // Matches are handed out in small batches from a shared counter. Result i always comes from seed
+    // firstSeed + i, so a sweep is reproducible whatever the thread count.
+    void run() {
+        results.assign(matches, MatchResult());
+        std::atomic<int> next(0);
+        const int batch = 16;
+        auto worker = [&]() {
+            std::unique_ptr<Game> game(new Game(true, tickRate, firstSeed));
+            game->setWorkerThreads(1);
+            game->setMaxEnemiesPerWave(maxEnemies);
+            game->setTuning(tuning);
+            ScriptedBot bots[MAX_PLAYERS];
+            for (;;) {
+                int begin = next.fetch_add(batch);
+                if (begin >= matches) break;
+                int end = std::min(matches, begin + batch);
+                for (int i = begin; i < end; ++i) results[i] = play(*game, bots, firstSeed + static_cast<Uint32>(i));
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (std::thread& thread : pool) thread.join();
+    }
+
+    void report(double seconds) const {
+        std::vector<double> survival, waves, scores;
+        int survived = 0;
+        Uint64 ticks = 0;
+        for (const MatchResult& result : results) {
+            survival.push_back(static_cast<double>(result.ticks) / tickRate);
+            waves.push_back(result.wave);
+            scores.push_back(result.score);
+            ticks += result.ticks;
+            if (result.survived) survived++;
+        }
+        printf("{\"matches\":%d,\"players\":%d,\"bot\":\"%s\",\"first_seed\":%u,\"tick_rate\":%d,\"max_ticks\":%u,"
+               "\"max_enemies\":%d,\"move_duration\":%d,\"shoot_cooldown\":%d,\"powerup_interval\":%u,\"base_enemies\":%d,"
+               "\"waves_per_enemy\":%d,\"survived\":%d,\"survival_s\":%s,\"wave\":%s,\"score\":%s,"
+               "\"seconds\":%.3f,\"matches_per_minute\":%.0f,\"ticks_per_second\":%.0f}\n",
+               matches, players, BOT_NAMES[style], firstSeed, tickRate, maxTicks, maxEnemies, tuning.enemyMoveDuration,
+               tuning.enemyShootCooldown, tuning.powerUpSpawnInterval, tuning.baseEnemies, tuning.wavesPerExtraEnemy,
+               survived, Distribution::of(survival).json().c_str(), Distribution::of(waves).json().c_str(),
+               Distribution::of(scores).json().c_str(), seconds, seconds > 0 ? matches * 60.0 / seconds : 0,
+               seconds > 0 ? ticks / seconds : 0);
+        fflush(stdout);
+    }
+};
+
+static std::vector<int> parseList(const char* text) {
+    std::vector<int> values;
+    for (const char* p = text; *p;) {
+        char* end = nullptr;
+        long value = strtol(p, &end, 10);
+        if (end == p) break;
+        values.push_back(static_cast<int>(value));
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+int main(int argc, char* argv[]) {
+    MatchRunner runner;
+    GameTuning defaults;
+    std::vector<int> moveDurations = {defaults.enemyMoveDuration};
+    std::vector<int> shootCooldowns = {defaults.enemyShootCooldown};
+    std::vector<int> powerUpIntervals = {static_cast<int>(defaults.powerUpSpawnInterval)};
+    std::vector<int> baseEnemies = {defaults.baseEnemies};
+    std::vector<int> wavesPerEnemy = {defaults.wavesPerExtraEnemy};
+    bool ticksGiven = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--matches") == 0 && i + 1 < argc) {
+            runner.matches = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            runner.threads = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--2p") == 0) {
+            runner.players = 2;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            runner.firstSeed = static_cast<Uint32>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+            runner.maxTicks = static_cast<Uint32>(std::max(1, atoi(argv[++i])));
+            ticksGiven = true;
+        } else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            runner.tickRate = atoi(argv[++i]);
+            if (!Game::validTickRate(runner.tickRate)) {
+                std::cerr << "Tick rate must be between " << MIN_TICK_RATE << " and " << MAX_TICK_RATE << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--max-enemies") == 0 && i + 1 < argc) {
+            runner.maxEnemies = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bot") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "hunter") == 0) {
+                runner.style = BOT_HUNTER;
+            } else if (strcmp(name, "wander") == 0) {
+                runner.style = BOT_WANDER;
+            } else {
+                std::cerr << "Unknown bot " << name << "; use hunter or wander" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--move-duration") == 0 && i + 1 < argc) {
+            moveDurations = parseList(argv[++i]);
+        } else if (strcmp(argv[i], "--shoot-cooldown") == 0 && i + 1 < argc) {
+            shootCooldowns = parseList(argv[++i]);
+        } else if (strcmp(argv[i], "--powerup-interval") == 0 && i + 1 < argc) {
+            powerUpIntervals = parseList(argv[++i]);
+        } else if (strcmp(argv[i], "--base-enemies") == 0 && i + 1 < argc) {
+            baseEnemies = parseList(argv[++i]);
+        } else if (strcmp(argv[i], "--waves-per-enemy") == 0 && i + 1 < argc) {
+            wavesPerEnemy = parseList(argv[++i]);
+        }
+    }
+    // Ten minutes of game time unless --ticks says otherwise.
+    if (!ticksGiven) runner.maxTicks = static_cast<Uint32>(runner.tickRate) * 60 * 10;
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    for (int moveDuration : moveDurations) {
+        for (int shootCooldown : shootCooldowns) {
+            for (int powerUpInterval : powerUpIntervals) {
+                for (int base : baseEnemies) {
+                    for (int perEnemy : wavesPerEnemy) {
+                        runner.tuning.enemyMoveDuration = std::max(1, moveDuration);
+                        runner.tuning.enemyShootCooldown = std::max(0, shootCooldown);
+                        runner.tuning.powerUpSpawnInterval = static_cast<Uint32>(std::max(0, powerUpInterval));
+                        runner.tuning.baseEnemies = std::max(1, base);
+                        runner.tuning.wavesPerExtraEnemy = std::max(1, perEnemy);
+                        Uint64 start = SDL_GetPerformanceCounter();
+                        runner.run();
+                        runner.report(static_cast<double>(SDL_GetPerformanceCounter() - start) / frequency);
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+// Build-time asset packer. Writes every file in GAME_ASSETS plus a TrueType font into one indexed .bcpk
+// archive, which battlecity maps at startup instead of opening loose files.
+// Build: g++ -O2 -std=c++17 packassets.cpp -o packassets $(sdl2-config --cflags --libs) -lSDL2_image -lSDL2_ttf -lSDL2_mixer
+// Usage: ./packassets [--font path.ttf] [--dir asset_dir] [battlecity.bcpk]
+#define BATTLECITY_NO_MAIN
+#include "battlecity.cpp"
+
+static bool fileExists(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return static_cast<bool>(in);
+}
+
+int main(int argc, char* argv[]) {
+    std::string output = "battlecity.bcpk";
+    std::string directory = ".";
+    std::string font;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--font") == 0 && i + 1 < argc) {
+            font = argv[++i];
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else {
+            output = argv[i];
+        }
+    }
+
+    if (font.empty()) {
+        for (const char* path : SYSTEM_FONTS) {
+            if (fileExists(path)) {
+                font = path;
+                break;
+            }
+        }
+    }
+    if (font.empty()) {
+        std::cerr << "No font found; pass --font path.ttf" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::string>> files;
+    for (const char* name : GAME_ASSETS) files.push_back({name, directory + "/" + name});
+    files.push_back({ARCHIVE_FONT, font});
+    if (!AssetArchive::write(output, files)) return 1;
+
+    AssetArchive archive;
+    if (!archive.open(output)) return 1;
+    std::cout << "Packed " << archive.entryCount << " files (" << archive.file.size << " bytes, font " << font
+              << ") into " << output << std::endl;
+    return 0;
+}